@@ -44,7 +44,7 @@ config_load(const string & file)
 #define BUF_SZ 4096
 	char buf[BUF_SZ];
 	char section[BUF_SZ];
-	const char * sep = " =\t";
+	const char * sep = " =\t\r\n";
 
 	config_section_t * cur = 0;
 	FILE * f = fopen(file.c_str(), "rb");
@@ -60,10 +60,88 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 #include "event.h"
 #include "config.h"
 #include "evutil.h"
+#include "log.h"
+
+/*
+ * A segment of the chain: allocated with its data, the moved region of
+ * another buffer or a reference to memory of the caller.
+ */
+struct evbuffer_seg {
+	struct evbuffer_seg *next;
+	u_char *data;		/* unread bytes */
+	size_t len;
+	size_t space;		/* free bytes after them, 0 for references */
+	void *mem;		/* region to free, NULL if none */
+	void (*cleanup)(void *);
+	void *arg;
+};
+
+/* smallest allocated segment, regions up to it grow in place */
+#define EVBUFFER_SEG_SIZE	4096
+/* largest allocated segment unless one append needs more */
+#define EVBUFFER_MAX_SEG	65536
+/* smaller buffers are copied instead of moved as segments */
+#define EVBUFFER_MIN_MOVE	512
+/* segments written by one writev */
+#define EVBUFFER_MAX_IOV	64
+
+static struct evbuffer_seg *
+evbuffer_seg_new(size_t size)
+{
+	struct evbuffer_seg *seg;
+
+	if ((seg = malloc(sizeof(struct evbuffer_seg) + size)) == NULL)
+		return (NULL);
+	seg->next = NULL;
+	seg->data = (u_char *)(seg + 1);
+	seg->len = 0;
+	seg->space = size;
+	seg->mem = NULL;
+	seg->cleanup = NULL;
+	seg->arg = NULL;
+	return (seg);
+}
+
+static void
+evbuffer_seg_free(struct evbuffer_seg *seg)
+{
+	if (seg->cleanup != NULL)
+		(*seg->cleanup)(seg->arg);
+	if (seg->mem != NULL)
+		free(seg->mem);
+	free(seg);
+}
+
+static void
+evbuffer_chain_append(struct evbuffer *buf, struct evbuffer_seg *seg)
+{
+	if (buf->chain == NULL)
+		buf->chain = seg;
+	else
+		buf->chain_last->next = seg;
+	buf->chain_last = seg;
+	buf->chain_off += seg->len;
+}
+
+static void
+evbuffer_chain_free(struct evbuffer *buf)
+{
+	struct evbuffer_seg *seg, *next;
+
+	for (seg = buf->chain; seg != NULL; seg = next) {
+		next = seg->next;
+		evbuffer_seg_free(seg);
+	}
+	buf->chain = buf->chain_last = NULL;
+	buf->chain_off = 0;
+}
 
 struct evbuffer *
 evbuffer_new(void)
@@ -78,11 +156,28 @@ evbuffer_new(void)
 void
 evbuffer_free(struct evbuffer *buffer)
 {
+	evbuffer_chain_free(buffer);
 	if (buffer->orig_buffer != NULL)
 		free(buffer->orig_buffer);
 	free(buffer);
 }
 
+void
+evbuffer_reset(struct evbuffer *buffer, size_t max)
+{
+	evbuffer_chain_free(buffer);
+	if (buffer->totallen > max) {
+		free(buffer->orig_buffer);
+		buffer->orig_buffer = NULL;
+		buffer->totallen = 0;
+	}
+	buffer->buffer = buffer->orig_buffer;
+	buffer->misalign = 0;
+	buffer->off = 0;
+	buffer->cb = NULL;
+	buffer->cbarg = NULL;
+}
+
 /* 
  * This is a destructive add.  The data from one buffer moves into
  * the other buffer.
@@ -94,17 +189,22 @@ evbuffer_free(struct evbuffer *buffer)
 	(x)->misalign = (y)->misalign; \
 	(x)->totallen = (y)->totallen; \
 	(x)->off = (y)->off; \
+	(x)->chain = (y)->chain; \
+	(x)->chain_last = (y)->chain_last; \
+	(x)->chain_off = (y)->chain_off; \
 } while (0)
 
 int
 evbuffer_add_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 {
+	size_t oldoff = EVBUFFER_LENGTH(outbuf);
+	size_t inoff = EVBUFFER_LENGTH(inbuf);
+	struct evbuffer_seg *seg;
 	int res;
 
 	/* Short cut for better performance */
-	if (outbuf->off == 0) {
+	if (oldoff == 0) {
 		struct evbuffer tmp;
-		size_t oldoff = inbuf->off;
 
 		/* Swap them directly */
 		SWAP(&tmp, outbuf);
@@ -113,42 +213,97 @@ evbuffer_add_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 
 		/* 
 		 * Optimization comes with a price; we need to notify the
-		 * buffer if necessary of the changes. oldoff is the amount
+		 * buffer if necessary of the changes. inoff is the amount
 		 * of data that we transfered from inbuf to outbuf
 		 */
-		if (inbuf->off != oldoff && inbuf->cb != NULL)
-			(*inbuf->cb)(inbuf, oldoff, inbuf->off, inbuf->cbarg);
-		if (oldoff && outbuf->cb != NULL)
-			(*outbuf->cb)(outbuf, 0, oldoff, outbuf->cbarg);
+		if (EVBUFFER_LENGTH(inbuf) != inoff && inbuf->cb != NULL)
+			(*inbuf->cb)(inbuf, inoff, EVBUFFER_LENGTH(inbuf),
+			    inbuf->cbarg);
+		if (inoff && outbuf->cb != NULL)
+			(*outbuf->cb)(outbuf, 0, inoff, outbuf->cbarg);
 		
 		return (0);
 	}
 
-	res = evbuffer_add(outbuf, inbuf->buffer, inbuf->off);
-	if (res == 0) {
-		/* We drain the input buffer on success */
-		evbuffer_drain(inbuf, inbuf->off);
+	if (inoff < EVBUFFER_MIN_MOVE) {
+		res = evbuffer_add(outbuf, EVBUFFER_DATA(inbuf), inoff);
+		if (res == 0) {
+			/* We drain the input buffer on success */
+			evbuffer_drain(inbuf, inoff);
+		}
+		return (res);
 	}
 
-	return (res);
+	/* the region of inbuf becomes a segment, then its chain follows */
+	if (inbuf->off > 0) {
+		if ((seg = malloc(sizeof(struct evbuffer_seg))) == NULL)
+			return (-1);
+		seg->next = NULL;
+		seg->data = inbuf->buffer;
+		seg->len = inbuf->off;
+		seg->space = inbuf->totallen - inbuf->misalign - inbuf->off;
+		seg->mem = inbuf->orig_buffer;
+		seg->cleanup = NULL;
+		seg->arg = NULL;
+		evbuffer_chain_append(outbuf, seg);
+		inbuf->buffer = inbuf->orig_buffer = NULL;
+		inbuf->misalign = inbuf->totallen = inbuf->off = 0;
+	}
+	if (inbuf->chain != NULL) {
+		if (outbuf->chain == NULL)
+			outbuf->chain = inbuf->chain;
+		else
+			outbuf->chain_last->next = inbuf->chain;
+		outbuf->chain_last = inbuf->chain_last;
+		outbuf->chain_off += inbuf->chain_off;
+		inbuf->chain = inbuf->chain_last = NULL;
+		inbuf->chain_off = 0;
+	}
+
+	if (inbuf->cb != NULL)
+		(*inbuf->cb)(inbuf, inoff, 0, inbuf->cbarg);
+	if (outbuf->cb != NULL)
+		(*outbuf->cb)(outbuf, oldoff, oldoff + inoff, outbuf->cbarg);
+
+	return (0);
+}
+
+int
+evbuffer_add_reference(struct evbuffer *buf, const void *data, size_t datlen,
+    void (*cleanup)(void *), void *arg)
+{
+	size_t oldoff = EVBUFFER_LENGTH(buf);
+	struct evbuffer_seg *seg;
+
+	if ((seg = malloc(sizeof(struct evbuffer_seg))) == NULL)
+		return (-1);
+	seg->next = NULL;
+	seg->data = (u_char *)data;
+	seg->len = datlen;
+	seg->space = 0;
+	seg->mem = NULL;
+	seg->cleanup = cleanup;
+	seg->arg = arg;
+	evbuffer_chain_append(buf, seg);
+
+	if (datlen && buf->cb != NULL)
+		(*buf->cb)(buf, oldoff, oldoff + datlen, buf->cbarg);
+
+	return (0);
 }
 
 int
 evbuffer_add_vprintf(struct evbuffer *buf, const char *fmt, va_list ap)
 {
 	char *buffer;
-	size_t space;
-	size_t oldoff = buf->off;
+	size_t space = 64;
 	int sz;
 	va_list aq;
 
-	/* make sure that at least some space is available */
-	evbuffer_expand(buf, 64);
 	for (;;) {
-		size_t used = buf->misalign + buf->off;
-		buffer = (char *)buf->buffer + buf->off;
-		assert(buf->totallen >= used);
-		space = buf->totallen - used;
+		/* make sure that at least some space is available */
+		if ((buffer = (char *)evbuffer_reserve(buf, space)) == NULL)
+			return (-1);
 
 #ifndef va_copy
 #define	va_copy(dst, src)	memcpy(&(dst), &(src), sizeof(va_list))
@@ -162,14 +317,10 @@ evbuffer_add_vprintf(struct evbuffer *buf, const char *fmt, va_list ap)
 		if (sz < 0)
 			return (-1);
 		if (sz < space) {
-			buf->off += sz;
-			if (buf->cb != NULL)
-				(*buf->cb)(buf, oldoff, buf->off, buf->cbarg);
+			evbuffer_commit(buf, sz);
 			return (sz);
 		}
-		if (evbuffer_expand(buf, sz + 1) == -1)
-			return (-1);
-
+		space = sz + 1;
 	}
 	/* NOTREACHED */
 }
@@ -187,16 +338,36 @@ evbuffer_add_printf(struct evbuffer *buf, const char *fmt, ...)
 	return (res);
 }
 
+/* Copies data of an event buffer segment by segment, without draining */
+
+int
+evbuffer_copyout(struct evbuffer *buf, void *data, size_t datlen)
+{
+	struct evbuffer_seg *seg;
+	size_t nread = datlen;
+	size_t n, done;
+
+	if (nread >= EVBUFFER_LENGTH(buf))
+		nread = EVBUFFER_LENGTH(buf);
+
+	done = nread < buf->off ? nread : buf->off;
+	memcpy(data, buf->buffer, done);
+	for (seg = buf->chain; done < nread; seg = seg->next) {
+		n = nread - done < seg->len ? nread - done : seg->len;
+		memcpy((u_char *)data + done, seg->data, n);
+		done += n;
+	}
+
+	return (nread);
+}
+
 /* Reads data from an event buffer and drains the bytes read */
 
 int
 evbuffer_remove(struct evbuffer *buf, void *data, size_t datlen)
 {
-	size_t nread = datlen;
-	if (nread >= buf->off)
-		nread = buf->off;
+	int nread = evbuffer_copyout(buf, data, datlen);
 
-	memcpy(data, buf->buffer, nread);
 	evbuffer_drain(buf, nread);
 	
 	return (nread);
@@ -259,10 +430,10 @@ evbuffer_align(struct evbuffer *buf)
 	buf->misalign = 0;
 }
 
-/* Expands the available space in the event buffer to at least datlen */
+/* Expands the space after the first region to at least datlen */
 
-int
-evbuffer_expand(struct evbuffer *buf, size_t datlen)
+static int
+evbuffer_expand_region(struct evbuffer *buf, size_t datlen)
 {
 	size_t need = buf->misalign + buf->off + datlen;
 
@@ -297,35 +468,145 @@ evbuffer_expand(struct evbuffer *buf, size_t datlen)
 	return (0);
 }
 
+u_char *
+evbuffer_pullup(struct evbuffer *buf)
+{
+	struct evbuffer_seg *seg;
+
+	if (buf->chain == NULL)
+		return (buf->buffer);
+
+	if (evbuffer_expand_region(buf, buf->chain_off) == -1)
+		return (NULL);
+	for (seg = buf->chain; seg != NULL; seg = seg->next) {
+		memcpy(buf->buffer + buf->off, seg->data, seg->len);
+		buf->off += seg->len;
+	}
+	evbuffer_chain_free(buf);
+
+	return (buf->buffer);
+}
+
+u_char *
+evbuffer_data(struct evbuffer *buf)
+{
+	u_char *data = evbuffer_pullup(buf);
+
+	if (data == NULL)
+		event_err(1, "%s: realloc", __func__);
+	return (data);
+}
+
+/*
+ * Expands the available space in the event buffer to at least datlen,
+ * where evbuffer_reserve returns it.  A chain is not made contiguous,
+ * its last segment gets the room.
+ */
+
+int
+evbuffer_expand(struct evbuffer *buf, size_t datlen)
+{
+	return (evbuffer_reserve(buf, datlen) == NULL ? -1 : 0);
+}
+
 int
 evbuffer_add(struct evbuffer *buf, const void *data, size_t datlen)
 {
-	size_t need = buf->misalign + buf->off + datlen;
-	size_t oldoff = buf->off;
+	u_char *p;
 
-	if (buf->totallen < need) {
-		if (evbuffer_expand(buf, datlen) == -1)
-			return (-1);
+	if ((p = evbuffer_reserve(buf, datlen)) == NULL)
+		return (-1);
+
+	memcpy(p, data, datlen);
+	evbuffer_commit(buf, datlen);
+
+	return (0);
+}
+
+u_char *
+evbuffer_reserve(struct evbuffer *buf, size_t datlen)
+{
+	struct evbuffer_seg *seg;
+	size_t size;
+
+	if (buf->chain == NULL) {
+		if (buf->totallen - buf->misalign - buf->off >= datlen)
+			return (buf->buffer + buf->off);
+
+		/* a small region grows, a large one is not copied again */
+		if (buf->totallen < EVBUFFER_SEG_SIZE || buf->off == 0) {
+			if (evbuffer_expand_region(buf, datlen) == -1)
+				return (NULL);
+			return (buf->buffer + buf->off);
+		}
+	} else if (buf->chain_last->space >= datlen) {
+		seg = buf->chain_last;
+		return (seg->data + seg->len);
 	}
 
-	memcpy(buf->buffer + buf->off, data, datlen);
-	buf->off += datlen;
+	/* segments double with the buffer up to EVBUFFER_MAX_SEG */
+	size = EVBUFFER_LENGTH(buf);
+	if (size < EVBUFFER_SEG_SIZE)
+		size = EVBUFFER_SEG_SIZE;
+	if (size > EVBUFFER_MAX_SEG)
+		size = EVBUFFER_MAX_SEG;
+	if (size < datlen)
+		size = datlen;
+	if ((seg = evbuffer_seg_new(size)) == NULL)
+		return (NULL);
+	evbuffer_chain_append(buf, seg);
 
-	if (datlen && buf->cb != NULL)
-		(*buf->cb)(buf, oldoff, buf->off, buf->cbarg);
+	return (seg->data);
+}
 
-	return (0);
+void
+evbuffer_commit(struct evbuffer *buf, size_t datlen)
+{
+	size_t oldoff = EVBUFFER_LENGTH(buf);
+
+	if (buf->chain != NULL) {
+		buf->chain_last->len += datlen;
+		buf->chain_last->space -= datlen;
+		buf->chain_off += datlen;
+	} else {
+		buf->off += datlen;
+	}
+
+	if (datlen && buf->cb != NULL)
+		(*buf->cb)(buf, oldoff, oldoff + datlen, buf->cbarg);
 }
 
 void
 evbuffer_drain(struct evbuffer *buf, size_t len)
 {
-	size_t oldoff = buf->off;
+	size_t oldoff = EVBUFFER_LENGTH(buf);
+	struct evbuffer_seg *seg;
+
+	if (len >= oldoff) {
+		evbuffer_chain_free(buf);
+		buf->off = 0;
+		buf->buffer = buf->orig_buffer;
+		buf->misalign = 0;
+		goto done;
+	}
 
 	if (len >= buf->off) {
+		len -= buf->off;
 		buf->off = 0;
 		buf->buffer = buf->orig_buffer;
 		buf->misalign = 0;
+
+		/* segments are released as soon as they are drained */
+		while ((seg = buf->chain) != NULL && len >= seg->len) {
+			len -= seg->len;
+			buf->chain_off -= seg->len;
+			buf->chain = seg->next;
+			evbuffer_seg_free(seg);
+		}
+		/* the chain is not empty, len is less than its length */
+		seg->data += len;
+		seg->len -= len;
+		buf->chain_off -= len;
 		goto done;
 	}
 
@@ -336,8 +617,8 @@ evbuffer_drain(struct evbuffer *buf, size_t len)
 
  done:
 	/* Tell someone about changes in this buffer */
-	if (buf->off != oldoff && buf->cb != NULL)
-		(*buf->cb)(buf, oldoff, buf->off, buf->cbarg);
+	if (EVBUFFER_LENGTH(buf) != oldoff && buf->cb != NULL)
+		(*buf->cb)(buf, oldoff, EVBUFFER_LENGTH(buf), buf->cbarg);
 
 }
 
@@ -351,9 +632,14 @@ int
 evbuffer_read(struct evbuffer *buf, int fd, int howmuch)
 {
 	u_char *p;
-	size_t oldoff = buf->off;
+	size_t oldoff;
 	int n = EVBUFFER_MAX_READ;
 
+	/* data is read after the first region */
+	if (buf->chain != NULL && evbuffer_pullup(buf) == NULL)
+		return (-1);
+	oldoff = buf->off;
+
 #if defined(FIONREAD)
 #ifdef WIN32
 	long lng = n;
@@ -380,7 +666,7 @@ evbuffer_read(struct evbuffer *buf, int fd, int howmuch)
 		howmuch = n;
 
 	/* If we don't have FIONREAD, we might waste some space here */
-	if (evbuffer_expand(buf, howmuch) == -1)
+	if (evbuffer_expand_region(buf, howmuch) == -1)
 		return (-1);
 
 	/* We can append new data at this point */
@@ -405,15 +691,45 @@ evbuffer_read(struct evbuffer *buf, int fd, int howmuch)
 	return (n);
 }
 
+#ifndef WIN32
+/* fills up to n iovecs with the data of buf, returns their number */
+static int
+evbuffer_iovec(struct evbuffer *buf, struct iovec *iov, int n)
+{
+	struct evbuffer_seg *seg;
+	int i = 0;
+
+	if (buf->off > 0 && i < n) {
+		iov[i].iov_base = buf->buffer;
+		iov[i].iov_len = buf->off;
+		i++;
+	}
+	for (seg = buf->chain; seg != NULL && i < n; seg = seg->next) {
+		if (seg->len == 0)
+			continue;
+		iov[i].iov_base = seg->data;
+		iov[i].iov_len = seg->len;
+		i++;
+	}
+	return (i);
+}
+#endif
+
 int
 evbuffer_write(struct evbuffer *buffer, int fd)
 {
 	int n;
 
 #ifndef WIN32
-	n = write(fd, buffer->buffer, buffer->off);
+	if (buffer->chain != NULL) {
+		struct iovec iov[EVBUFFER_MAX_IOV];
+		n = writev(fd, iov, evbuffer_iovec(buffer, iov,
+			EVBUFFER_MAX_IOV));
+	} else {
+		n = write(fd, buffer->buffer, buffer->off);
+	}
 #else
-	n = send(fd, buffer->buffer, buffer->off, 0);
+	n = send(fd, EVBUFFER_DATA(buffer), EVBUFFER_LENGTH(buffer), 0);
 #endif
 	if (n == -1)
 		return (-1);
@@ -424,10 +740,46 @@ evbuffer_write(struct evbuffer *buffer, int fd)
 	return (n);
 }
 
+int
+evbuffer_write_pair(struct evbuffer *first, struct evbuffer *second, int fd)
+{
+#ifndef WIN32
+	struct iovec iov[EVBUFFER_MAX_IOV];
+	size_t off1 = EVBUFFER_LENGTH(first);
+	int n, niov;
+
+	if (EVBUFFER_LENGTH(second) == 0)
+		return (evbuffer_write(first, fd));
+	if (off1 == 0)
+		return (evbuffer_write(second, fd));
+
+	niov = evbuffer_iovec(first, iov, EVBUFFER_MAX_IOV);
+	niov += evbuffer_iovec(second, iov + niov, EVBUFFER_MAX_IOV - niov);
+	n = writev(fd, iov, niov);
+	if (n == -1)
+		return (-1);
+	if (n == 0)
+		return (0);
+	if ((size_t)n <= off1) {
+		evbuffer_drain(first, n);
+	} else {
+		evbuffer_drain(first, off1);
+		evbuffer_drain(second, n - off1);
+	}
+
+	return (n);
+#else
+	if (EVBUFFER_LENGTH(first) == 0)
+		return (evbuffer_write(second, fd));
+	return (evbuffer_write(first, fd));
+#endif
+}
+
 u_char *
 evbuffer_find(struct evbuffer *buffer, const u_char *what, size_t len)
 {
-	u_char *search = buffer->buffer, *end = search + buffer->off;
+	u_char *search = EVBUFFER_DATA(buffer);
+	u_char *end = search + EVBUFFER_LENGTH(buffer);
 	u_char *p;
 
 	while (search < end &&
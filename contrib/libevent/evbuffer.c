@@ -344,9 +344,11 @@ bufferevent_write_buffer(struct bufferevent *bufev, struct evbuffer *buf)
 {
 	int res;
 
-	res = bufferevent_write(bufev, buf->buffer, buf->off);
-	if (res != -1)
-		evbuffer_drain(buf, buf->off);
+	/* moves the chain of buf, copies small buffers */
+	res = evbuffer_add_buffer(bufev->output, buf);
+	if (res != -1 && EVBUFFER_LENGTH(bufev->output) > 0 &&
+	    (bufev->enabled & EV_WRITE))
+		bufferevent_add(&bufev->ev_write, bufev->timeout_write);
 
 	return (res);
 }
@@ -354,18 +356,8 @@ bufferevent_write_buffer(struct bufferevent *bufev, struct evbuffer *buf)
 size_t
 bufferevent_read(struct bufferevent *bufev, void *data, size_t size)
 {
-	struct evbuffer *buf = bufev->input;
-
-	if (buf->off < size)
-		size = buf->off;
-
 	/* Copy the available data to the user buffer */
-	memcpy(data, buf->buffer, size);
-
-	if (size)
-		evbuffer_drain(buf, size);
-
-	return (size);
+	return (evbuffer_remove(bufev->input, data, size));
 }
 
 int
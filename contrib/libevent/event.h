@@ -245,6 +245,9 @@ struct evkeyval {
 
 	char *key;
 	char *value;
+	int flags;	/* EVKEYVAL_* of the http layer */
+	unsigned int hash;	/* of the lowercase key, 0 if not known yet */
+	int id;		/* well-known header, valid with hash */
 };
 
 #ifdef _EVENT_DEFINED_TQENTRY
@@ -719,6 +722,13 @@ int	event_priority_set(struct event *, int);
 
 /* These functions deal with buffering input and output */
 
+struct evbuffer_seg;
+
+/*
+ * The data of an evbuffer is the contiguous region at buffer, off bytes
+ * long, followed by the chain of segments.  Large appends, moved buffers
+ * and references go to the chain, EVBUFFER_DATA() makes it contiguous.
+ */
 struct evbuffer {
 	u_char *buffer;
 	u_char *orig_buffer;
@@ -729,6 +739,10 @@ struct evbuffer {
 
 	void (*cb)(struct evbuffer *, size_t, size_t, void *);
 	void *cbarg;
+
+	struct evbuffer_seg *chain;
+	struct evbuffer_seg *chain_last;
+	size_t chain_off;	/* bytes in the chain */
 };
 
 /* Just for error reporting - use other constants otherwise */
@@ -956,8 +970,10 @@ void bufferevent_settimeout(struct bufferevent *bufev,
 void bufferevent_setwatermark(struct bufferevent *bufev, short events,
     size_t lowmark, size_t highmark);
 
-#define EVBUFFER_LENGTH(x)	(x)->off
-#define EVBUFFER_DATA(x)	(x)->buffer
+#define EVBUFFER_LENGTH(x)	((x)->off + (x)->chain_off)
+/* makes a chain contiguous first, exits if that cannot allocate */
+#define EVBUFFER_DATA(x)	\
+	((x)->chain != NULL ? evbuffer_data(x) : (x)->buffer)
 #define EVBUFFER_INPUT(x)	(x)->input
 #define EVBUFFER_OUTPUT(x)	(x)->output
 
@@ -979,10 +995,24 @@ struct evbuffer *evbuffer_new(void);
 void evbuffer_free(struct evbuffer *);
 
 
+/**
+  Empties an evbuffer for reuse without calling its callback.
+
+  The storage is kept for the next user unless it is larger than max.
+  The callback is removed.
+
+  @param buf the evbuffer to be reset
+  @param max the largest storage in bytes to keep
+ */
+void evbuffer_reset(struct evbuffer *, size_t max);
+
+
 /**
   Expands the available space in an event buffer.
 
-  Expands the available space in the event buffer to at least datlen
+  Expands the available space in the event buffer to at least datlen,
+  the next evbuffer_reserve() of up to datlen bytes does not allocate.
+  The data of a buffer with a chain of segments is not moved.
 
   @param buf the event buffer to be expanded
   @param datlen the new minimum length requirement
@@ -1001,6 +1031,69 @@ int evbuffer_expand(struct evbuffer *, size_t);
 int evbuffer_add(struct evbuffer *, const void *, size_t);
 
 
+/**
+  Reserve space at the end of an evbuffer for writing in place.
+
+  The data becomes part of the buffer after evbuffer_commit().
+
+  @param buf the event buffer to be appended to
+  @param datlen the number of bytes to be reserved
+  @return pointer to datlen writable bytes, or NULL if an error occurred
+  @see evbuffer_commit()
+ */
+u_char *evbuffer_reserve(struct evbuffer *, size_t);
+
+
+/**
+  Append data written into the space of evbuffer_reserve().
+
+  @param buf the event buffer to be appended to
+  @param datlen the number of bytes written, at most the reserved length
+  @see evbuffer_reserve()
+ */
+void evbuffer_commit(struct evbuffer *, size_t);
+
+
+/**
+  Append read-only memory to an evbuffer without copying it.
+
+  The memory must stay valid until cleanup is called, when the data has
+  been drained or the buffer freed.
+
+  @param buf the event buffer to be appended to
+  @param data the memory to be referenced
+  @param datlen the number of bytes
+  @param cleanup called with arg when the data is released, or NULL
+  @param arg the argument of cleanup
+  @return 0 if successful, or -1 if an error occurred
+ */
+int evbuffer_add_reference(struct evbuffer *, const void *, size_t,
+    void (*cleanup)(void *), void *);
+
+
+/**
+  Make the data of an evbuffer contiguous.
+
+  Copies the segment chain behind the first region.
+
+  @param buf the event buffer
+  @return pointer to EVBUFFER_LENGTH(buf) contiguous bytes, or NULL if
+          the copy could not be allocated
+ */
+u_char *evbuffer_pullup(struct evbuffer *);
+
+/**
+  Make the data of an evbuffer contiguous, or exit.
+
+  EVBUFFER_DATA() calls it if there is a chain.  Unlike evbuffer_pullup()
+  it never returns NULL, an allocation failure is fatal.
+
+  @param buf the event buffer
+  @return pointer to EVBUFFER_LENGTH(buf) contiguous bytes
+ */
+u_char *evbuffer_data(struct evbuffer *);
+
+
 
 /**
   Read data from an event buffer and drain the bytes read.
@@ -1012,6 +1105,19 @@ int evbuffer_add(struct evbuffer *, const void *, size_t);
  */
 int evbuffer_remove(struct evbuffer *, void *, size_t);
 
+/**
+  Copy data of an event buffer without draining it.
+
+  Segments of the chain are copied one by one, the buffer is not made
+  contiguous as with EVBUFFER_DATA().
+
+  @param buf the event buffer to be read from
+  @param data the destination buffer to store the result
+  @param datlen the maximum size of the destination buffer
+  @return the number of bytes copied
+ */
+int evbuffer_copyout(struct evbuffer *, void *, size_t);
+
 
 /**
  * Read a single line from an event buffer.
@@ -1029,7 +1135,8 @@ char *evbuffer_readline(struct evbuffer *);
   Move data from one evbuffer into another evbuffer.
 
   This is a destructive add.  The data from one buffer moves into
-  the other buffer. The destination buffer is expanded as needed.
+  the other buffer.  Large buffers are linked to the destination as
+  segments without copying, small ones are copied.
 
   @param outbuf the output buffer
   @param inbuf the input buffer
@@ -1086,6 +1193,21 @@ void evbuffer_drain(struct evbuffer *, size_t);
  */
 int evbuffer_write(struct evbuffer *, int);
 
+/**
+  Write the contents of two evbuffers, one after the other, to a file
+  descriptor with a single writev(2), without copying them together.
+
+  The written bytes are drained from first and then from second.
+
+  @param first the evbuffer written first
+  @param second the evbuffer written after first
+  @param fd the file descriptor to be written to
+  @return the number of bytes written, or -1 if an error occurred
+  @see evbuffer_write()
+ */
+int evbuffer_write_pair(struct evbuffer *first, struct evbuffer *second,
+    int fd);
+
 
 /**
   Read from a file descriptor and store the result in an evbuffer.
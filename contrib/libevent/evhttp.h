@@ -63,6 +63,8 @@ extern "C" {
 
 struct evhttp;
 struct evhttp_request;
+struct evhttp_connection;
+struct evhttp_header_block;
 struct evkeyvalq;
 
 /** Create a new HTTP server
@@ -86,6 +88,26 @@ struct evhttp *evhttp_new(struct event_base *base);
  */
 int evhttp_bind_socket(struct evhttp *http, const char *address, u_short port);
 
+/**
+ * Binds an HTTP server with workers to a port with one SO_REUSEPORT
+ * socket per worker.
+ *
+ * Every worker accepts connections on its own event_base and the kernel
+ * spreads them between the sockets, instead of one accepting thread
+ * passing them to the workers.  Must be called after all
+ * evhttp_add_worker and before the worker loops are started.
+ * Without workers a single socket is bound as with evhttp_bind_socket.
+ *
+ * @param http a pointer to an evhttp object
+ * @param address a string containing the IP address to listen(2) on
+ * @param port the port number to listen on
+ * @return 0 on success, -1 on failure or if SO_REUSEPORT is not
+ *   supported, then evhttp_bind_socket may be used instead.
+ * @see evhttp_bind_socket(), evhttp_add_worker()
+ */
+int evhttp_bind_socket_reuseport(struct evhttp *http, const char *address,
+    u_short port);
+
 /**
  * Makes an HTTP server accept connections on the specified socket
  *
@@ -131,6 +153,69 @@ void evhttp_free(struct evhttp* http);
  */
 struct event_base * evhttp_add_worker(struct evhttp * http);
 
+/** Choice of a worker for an accepted connection */
+#define EVHTTP_DISPATCH_ROUND_ROBIN	0
+/** the fewest open and queued connections */
+#define EVHTTP_DISPATCH_LEAST_CONN	1
+/** the less loaded of two random workers */
+#define EVHTTP_DISPATCH_TWO_CHOICES	2
+/** the worker on the CPU that received the connection (SO_INCOMING_CPU),
+ * least loaded if unknown */
+#define EVHTTP_DISPATCH_CPU		3
+
+/**
+ * Sets how the accepting thread chooses workers, EVHTTP_DISPATCH_*.
+ *
+ * Applies to evhttp_bind_socket, with evhttp_bind_socket_reuseport the
+ * kernel chooses.  The default is EVHTTP_DISPATCH_ROUND_ROBIN.
+ */
+void evhttp_set_dispatch(struct evhttp *http, int policy);
+
+/**
+ * Sets the CPU of the worker running base for EVHTTP_DISPATCH_CPU.
+ *
+ * If no worker has a CPU, CPU n goes to the worker n modulo the number
+ * of workers.
+ *
+ * @return 0 on success, -1 if base is not a worker of http.
+ */
+int evhttp_worker_set_cpu(struct evhttp *http, struct event_base *base,
+    int cpu);
+
+/**
+ * Gets the gauges of the workers in the order of evhttp_add_worker.
+ *
+ * May be called from any thread.
+ *
+ * @param active open connections of up to n workers
+ * @param queued accepted connections not yet taken by up to n workers
+ * @return the number of workers.
+ */
+int evhttp_worker_stats(struct evhttp *http, int *active, int *queued, int n);
+
+/**
+ * Recycles the connection and request objects of incoming connections.
+ *
+ * Every worker keeps up to max freed objects of each kind together with
+ * their buffers, buffer storage above buffer_max bytes is released.
+ * The pool is disabled by default.
+ *
+ * @param max objects kept of each kind per worker, 0 disables the pool
+ * @param buffer_max the largest storage kept by a buffer
+ */
+void evhttp_set_pool(struct evhttp *http, int max, size_t buffer_max);
+
+/**
+ * Sums the pool counters of http and its workers.
+ *
+ * May be called from any thread.
+ *
+ * @param hits objects taken from a pool
+ * @param misses objects allocated because a pool was empty
+ */
+void evhttp_pool_stats(struct evhttp *http,
+    unsigned long *hits, unsigned long *misses);
+
 /** Set a callback for a specified URI */
 void evhttp_set_cb(struct evhttp *, const char *,
     void (*)(struct evhttp_request *, void *), void *);
@@ -177,8 +262,34 @@ void evhttp_send_reply(struct evhttp_request *req, int code,
 /* Low-level response interface, for streaming/chunked replies */
 void evhttp_send_reply_start(struct evhttp_request *, int, const char *);
 void evhttp_send_reply_chunk(struct evhttp_request *, struct evbuffer *);
+/* cb is called when the connection has written all its output */
+void evhttp_send_reply_chunk_with_cb(struct evhttp_request *,
+    struct evbuffer *, void (*cb)(struct evhttp_connection *, void *),
+    void *arg);
 void evhttp_send_reply_end(struct evhttp_request *);
 
+/**
+ * Serializes constant headers once, e.g. "Content-Type: text/html\r\n".
+ *
+ * Every line must end with CRLF and have a colon.  Date, Content-Length,
+ * Transfer-Encoding, Connection and Proxy-Connection are managed per
+ * message and are rejected.
+ *
+ * @param block the header lines
+ * @return a new block, or NULL if block is malformed
+ */
+struct evhttp_header_block *evhttp_header_block_new(const char *block);
+void evhttp_header_block_free(struct evhttp_header_block *);
+
+/**
+ * Sends the lines of block with the headers of req with one copy.
+ *
+ * The headers of the block are not in output_headers, the block must
+ * outlive the request.
+ */
+void evhttp_set_header_block(struct evhttp_request *req,
+    const struct evhttp_header_block *block);
+
 /**
  * Start an HTTP server on the specified address and port
  *
@@ -217,6 +328,8 @@ struct {
 	int flags;
 #define EVHTTP_REQ_OWN_CONNECTION	0x0001
 #define EVHTTP_PROXY_REQUEST		0x0002
+#define EVHTTP_REQ_ARENA		0x0004	/* strings in evcon's arena */
+#define EVHTTP_REQ_POOLED		0x0008	/* freed into the server pool */
 
 	struct evkeyvalq *input_headers;
 	struct evkeyvalq *output_headers;
@@ -252,6 +365,12 @@ struct {
 	 * the regular callback.
 	 */
 	void (*chunk_cb)(struct evhttp_request *, void *);
+
+	/* constant headers sent after output_headers */
+	const struct evhttp_header_block *header_block;
+
+	/* server whose pool an EVHTTP_REQ_POOLED request is freed into */
+	struct evhttp *pool;
 };
 
 /**
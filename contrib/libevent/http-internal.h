@@ -50,6 +50,49 @@ enum evhttp_connection_state {
 
 struct event_base;
 
+/* bump allocator for the strings and headers of a request */
+#define EVHTTP_ARENA_SIZE	2048
+
+struct evhttp_arena_block {
+	struct evhttp_arena_block *next;
+	void *align;		/* keeps the data after it pointer aligned */
+};
+
+struct evhttp_arena {
+	char *cur;		/* next free byte */
+	char *end;		/* end of the current block */
+	struct evhttp_arena_block *blocks;	/* overflow, freed on reset */
+	char first[EVHTTP_ARENA_SIZE];
+};
+
+/* a string inside a buffer, as offset and length */
+struct evhttp_view {
+	size_t off;
+	size_t len;
+};
+
+/* evkeyval flags */
+#define EVKEYVAL_ARENA		0x0001	/* node and strings in an arena */
+
+/* the headers the library looks at, ids of evkeyval */
+enum evhttp_header_id {
+	EVHTTP_HDR_OTHER,
+	EVHTTP_HDR_HOST,
+	EVHTTP_HDR_DATE,
+	EVHTTP_HDR_CONNECTION,
+	EVHTTP_HDR_CONTENT_TYPE,
+	EVHTTP_HDR_CONTENT_LENGTH,
+	EVHTTP_HDR_PROXY_CONNECTION,
+	EVHTTP_HDR_TRANSFER_ENCODING,
+	EVHTTP_HDR_MAX
+};
+
+/* the well-known headers of a list, found in one pass */
+struct evhttp_known {
+	int mask;			/* 1 << id of each present header */
+	const char *value[EVHTTP_HDR_MAX];	/* of the first header */
+};
+
 struct evhttp_connection {
 	/* we use tailq only if they were created for an http server */
 	TAILQ_ENTRY(evhttp_connection) (next);
@@ -59,12 +102,14 @@ struct evhttp_connection {
 	struct event close_ev;
 	struct evbuffer *input_buffer;
 	struct evbuffer *output_buffer;
+	struct evbuffer *output_body;	/* written after output_buffer */
 	
 	char *bind_address;		/* address to use for binding the src */
 	u_short bind_port;		/* local port for binding the src */
 
 	char *address;			/* address to connect to */
 	u_short port;
+	char host[48];			/* address of incoming connections */
 
 	int flags;
 #define EVHTTP_CON_INCOMING	0x0001	/* only one request on it ever */
@@ -89,6 +134,10 @@ struct evhttp_connection {
 	void *closecb_arg;
 
 	struct event_base *base;
+
+	/* request scoped allocations of incoming connections; stays the
+	 * last member, evhttp_pool_put_connection clears the ones before */
+	struct evhttp_arena arena;
 };
 
 struct evhttp_cb {
@@ -100,9 +149,28 @@ struct evhttp_cb {
 	void *cbarg;
 };
 
+/* serialized constant headers of evhttp_header_block_new */
+struct evhttp_header_block {
+	char *data;
+	size_t len;
+	int has_content_type;
+};
+
 /* both the http server as well as the rpc system need to queue connections */
 TAILQ_HEAD(evconq, evhttp_connection);
 
+/* freed objects of incoming connections kept for reuse by one thread */
+struct evhttp_pool {
+	struct evconq conns;
+	struct evcon_requestq reqs;
+	int nconns;
+	int nreqs;
+	int max;		/* objects of each kind, 0 disables the pool */
+	size_t buffer_max;	/* larger buffer storage is freed */
+	unsigned long hits;	/* read by other threads */
+	unsigned long misses;
+};
+
 /* each bound socket is stored in one of these */
 struct evhttp_bound_socket {
 	TAILQ_ENTRY(evhttp_bound_socket) (next);
@@ -112,13 +180,24 @@ struct evhttp_bound_socket {
 
 /* for multiple workers: */
 struct task {
-	TAILQ_ENTRY(task) next;
-
-	struct sockaddr_storage ss;
+	unsigned int seq;	/* ring position the slot is ready for */
 	int fd;
+	struct sockaddr_storage ss;
 };
 
-#include <pthread.h>
+/* bounded ring of accepted connections of a worker, the accepting
+ * thread pushes, the worker pops */
+#define EVHTTP_TASKS	1024
+/* tasks pushed to a worker before it is woken up inside an accept loop */
+#define EVHTTP_TASKS_WAKEUP	64
+/* milliseconds without accepting while the rings of all workers are full */
+#define EVHTTP_ACCEPT_PAUSE	10
+
+struct taskq {
+	struct task * ring;
+	unsigned int head;	/* next slot to pop, owned by the worker */
+	unsigned int tail;	/* next slot to push */
+};
 
 struct evhttp {
 	TAILQ_HEAD(boundq, evhttp_bound_socket) sockets;
@@ -134,13 +213,25 @@ struct evhttp {
 	struct event_base *base;
 
 	/* for multiple workers: */
-	pthread_mutex_t lock;
-	TAILQ_HEAD(taskq, task) tasks;
+	struct taskq tasks;
 	struct evhttp * next;
 	struct evhttp * cur;
 	struct event notify;
-	int wakeup;
-	int rcv;
+	int wakeup;		/* eventfd, or write end of a pipe */
+	int rcv;		/* same eventfd, or read end of the pipe */
+	int pending;		/* tasks pushed since the last wakeup */
+	int dispatch;		/* EVHTTP_DISPATCH_* of the accepting server */
+	unsigned int seed;	/* random choices of the dispatch */
+	int cpu;		/* CPU of a worker, -1 if not set */
+	int nactive;		/* open connections, read by other threads */
+	struct event accept_pause;	/* adds the listeners back */
+
+	struct evhttp_pool pool;
+
+	/* Date header line of the current second */
+	char date[48];
+	size_t date_len;
+	time_t date_time;
 };
 
 /* resets the connection; can be reused for more requests */
@@ -160,6 +251,9 @@ int evhttp_hostportfile(char *, char **, u_short *, char **);
 int evhttp_parse_firstline(struct evhttp_request *, struct evbuffer*);
 int evhttp_parse_headers(struct evhttp_request *, struct evbuffer*);
 
+/* frees what the requests of a connection allocated in its arena */
+void evhttp_arena_reset(struct evhttp_arena *);
+
 void evhttp_start_read(struct evhttp_connection *);
 void evhttp_make_header(struct evhttp_connection *, struct evhttp_request *);
 
@@ -29,6 +29,11 @@
 #include "config.h"
 #endif
 
+#ifdef __linux__
+/* accept4 */
+#define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_SYS_PARAM_H
 #include <sys/param.h>
 #endif
@@ -64,6 +69,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -78,6 +84,11 @@
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#define HAVE_EVENTFD 1
+#define HAVE_ACCEPT4 1
+#endif
 
 #undef timeout_pending
 #undef timeout_initialized
@@ -199,7 +210,11 @@ extern int debug;
 static int socket_connect(int fd, const char *address, unsigned short port);
 static int bind_socket_ai(struct addrinfo *, int reuse);
 static int bind_socket(const char *, u_short, int reuse);
-static void name_from_addr(struct sockaddr *, socklen_t, char **, char **);
+
+/* reuse flags of bind_socket */
+#define BIND_REUSEADDR	1
+#define BIND_REUSEPORT	2
+static int name_from_addr(struct sockaddr *, socklen_t, char *, char *);
 static int evhttp_associate_new_request_with_connection(
 	struct evhttp_connection *evcon);
 static void evhttp_connection_start_detectclose(
@@ -211,6 +226,18 @@ static void evhttp_read_firstline(struct evhttp_connection *evcon,
 				  struct evhttp_request *req);
 static void evhttp_read_header(struct evhttp_connection *evcon,
     struct evhttp_request *req);
+static int evhttp_add_header_arena(struct evhttp_arena *,
+    struct evkeyvalq *, const char *, const char *);
+static int evhttp_add_header_view(struct evhttp_arena *,
+    struct evkeyvalq *, const char *, size_t, const char *, size_t);
+static int evhttp_pool_put_connection(struct evhttp *,
+    struct evhttp_connection *);
+static int evhttp_pool_put_request(struct evhttp *,
+    struct evhttp_request *);
+
+/* the arena of a request, NULL if its strings are malloced */
+#define EVHTTP_REQ_ARENA_OF(req) \
+	((req)->flags & EVHTTP_REQ_ARENA ? &(req)->evcon->arena : NULL)
 
 void evhttp_read(int, short, void *);
 void evhttp_write(int, short, void *);
@@ -236,6 +263,73 @@ strsep(char **s, const char *del)
 }
 #endif
 
+static void
+evhttp_arena_init(struct evhttp_arena *arena)
+{
+	arena->cur = arena->first;
+	arena->end = arena->first + sizeof(arena->first);
+	arena->blocks = NULL;
+}
+
+/* frees the overflow blocks and starts again in the first block */
+void
+evhttp_arena_reset(struct evhttp_arena *arena)
+{
+	struct evhttp_arena_block *block;
+
+	while ((block = arena->blocks) != NULL) {
+		arena->blocks = block->next;
+		free(block);
+	}
+	evhttp_arena_init(arena);
+}
+
+static void *
+evhttp_arena_alloc(struct evhttp_arena *arena, size_t size)
+{
+	char *p;
+
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if (size > (size_t)(arena->end - arena->cur)) {
+		struct evhttp_arena_block *block;
+		size_t len = size > EVHTTP_ARENA_SIZE ? size : EVHTTP_ARENA_SIZE;
+
+		if ((block = malloc(sizeof(*block) + len)) == NULL)
+			return (NULL);
+		block->next = arena->blocks;
+		arena->blocks = block;
+		arena->cur = (char *)(block + 1);
+		arena->end = arena->cur + len;
+	}
+
+	p = arena->cur;
+	arena->cur += size;
+	return (p);
+}
+
+/* copies len bytes of str into a string of arena, malloced if NULL */
+static char *
+evhttp_arena_strndup(struct evhttp_arena *arena, const char *str, size_t len)
+{
+	char *p;
+
+	if (arena == NULL)
+		p = malloc(len + 1);
+	else
+		p = evhttp_arena_alloc(arena, len + 1);
+	if (p != NULL) {
+		memcpy(p, str, len);
+		p[len] = '\0';
+	}
+	return (p);
+}
+
+static char *
+evhttp_arena_strdup(struct evhttp_arena *arena, const char *str)
+{
+	return (evhttp_arena_strndup(arena, str, strlen(str)));
+}
+
 static const char *
 html_replace(char ch, char *buf)
 {
@@ -367,6 +461,85 @@ evhttp_connected(struct evhttp_connection *evcon)
 	}
 }
 
+/* FNV-1a of the lowercase key, never 0 */
+static unsigned int
+evhttp_header_hash(const char *key, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned int hash = 2166136261U;
+
+	while (len-- > 0)
+		hash = (hash ^ (*p++ | 0x20)) * 16777619U;
+	return (hash | 1);
+}
+
+/* the names of the well-known headers differ in length but for two */
+static int
+evhttp_header_id(const char *key, size_t len)
+{
+	switch (len) {
+	case 4:
+		if (strncasecmp(key, "Host", len) == 0)
+			return (EVHTTP_HDR_HOST);
+		if (strncasecmp(key, "Date", len) == 0)
+			return (EVHTTP_HDR_DATE);
+		break;
+	case 10:
+		if (strncasecmp(key, "Connection", len) == 0)
+			return (EVHTTP_HDR_CONNECTION);
+		break;
+	case 12:
+		if (strncasecmp(key, "Content-Type", len) == 0)
+			return (EVHTTP_HDR_CONTENT_TYPE);
+		break;
+	case 14:
+		if (strncasecmp(key, "Content-Length", len) == 0)
+			return (EVHTTP_HDR_CONTENT_LENGTH);
+		break;
+	case 16:
+		if (strncasecmp(key, "Proxy-Connection", len) == 0)
+			return (EVHTTP_HDR_PROXY_CONNECTION);
+		break;
+	case 17:
+		if (strncasecmp(key, "Transfer-Encoding", len) == 0)
+			return (EVHTTP_HDR_TRANSFER_ENCODING);
+		break;
+	}
+	return (EVHTTP_HDR_OTHER);
+}
+
+/* headers linked by the user directly are classified on first use */
+static void
+evhttp_header_classify(struct evkeyval *header)
+{
+	size_t len = strlen(header->key);
+
+	header->hash = evhttp_header_hash(header->key, len);
+	header->id = evhttp_header_id(header->key, len);
+}
+
+static void
+evhttp_headers_known(const struct evkeyvalq *headers,
+    struct evhttp_known *known)
+{
+	struct evkeyval *header;
+
+	known->mask = 0;
+	TAILQ_FOREACH(header, headers, next) {
+		if (header->hash == 0)
+			evhttp_header_classify(header);
+		if (header->id == EVHTTP_HDR_OTHER ||
+		    (known->mask & (1 << header->id)))
+			continue;
+		known->mask |= 1 << header->id;
+		known->value[header->id] = header->value;
+	}
+}
+
+/* the value of the first header id of known, or NULL */
+#define EVHTTP_KNOWN(known, id) \
+	((known)->mask & (1 << (id)) ? (known)->value[id] : NULL)
+
 /*
  * Create the headers needed for an HTTP request
  */
@@ -377,7 +550,10 @@ evhttp_make_header_request(struct evhttp_connection *evcon,
 	char line[1024];
 	const char *method;
 	
+	struct evhttp_known out;
+
 	evhttp_remove_header(req->output_headers, "Proxy-Connection");
+	evhttp_headers_known(req->output_headers, &out);
 
 	/* Generate request line */
 	method = evhttp_method(req->type);
@@ -387,7 +563,7 @@ evhttp_make_header_request(struct evhttp_connection *evcon,
 
 	/* Add the content length on a post request if missing */
 	if (req->type == EVHTTP_REQ_POST &&
-	    evhttp_find_header(req->output_headers, "Content-Length") == NULL){
+	    EVHTTP_KNOWN(&out, EVHTTP_HDR_CONTENT_LENGTH) == NULL) {
 		char size[12];
 		evutil_snprintf(size, sizeof(size), "%ld",
 		    (long)EVBUFFER_LENGTH(req->output_buffer));
@@ -396,58 +572,78 @@ evhttp_make_header_request(struct evhttp_connection *evcon,
 }
 
 static int
-evhttp_is_connection_close(int flags, struct evkeyvalq* headers)
+evhttp_is_connection_close(int flags, const struct evhttp_known *known)
 {
 	if (flags & EVHTTP_PROXY_REQUEST) {
 		/* proxy connection */
-		const char *connection = evhttp_find_header(headers, "Proxy-Connection");
+		const char *connection =
+		    EVHTTP_KNOWN(known, EVHTTP_HDR_PROXY_CONNECTION);
 		return (connection == NULL || strcasecmp(connection, "keep-alive") != 0);
 	} else {
-		const char *connection = evhttp_find_header(headers, "Connection");
+		const char *connection =
+		    EVHTTP_KNOWN(known, EVHTTP_HDR_CONNECTION);
 		return (connection != NULL && strcasecmp(connection, "close") == 0);
 	}
 }
 
 static int
-evhttp_is_connection_keepalive(struct evkeyvalq* headers)
+evhttp_is_connection_keepalive(const struct evhttp_known *known)
 {
-	const char *connection = evhttp_find_header(headers, "Connection");
+	const char *connection = EVHTTP_KNOWN(known, EVHTTP_HDR_CONNECTION);
 	return (connection != NULL 
 	    && strncasecmp(connection, "keep-alive", 10) == 0);
 }
 
+/* the Date line is formatted once per second and server */
 static void
-evhttp_maybe_add_date_header(struct evkeyvalq *headers)
+evhttp_maybe_add_date_header(struct evhttp_connection *evcon,
+    const struct evhttp_known *out)
 {
-	if (evhttp_find_header(headers, "Date") == NULL) {
-		char date[50];
+	struct evhttp *http = evcon->http_server;
+	char date[sizeof(http->date)];
+	size_t len;
 #ifndef WIN32
-		struct tm cur;
+	struct tm cur;
 #endif
-		struct tm *cur_p;
-		time_t t = time(NULL);
+	struct tm *cur_p;
+	time_t t;
+
+	if (out->mask & (1 << EVHTTP_HDR_DATE))
+		return;
+
+	t = time(NULL);
+	if (http != NULL && http->date_time == t) {
+		evbuffer_add(evcon->output_buffer, http->date, http->date_len);
+		return;
+	}
 #ifdef WIN32
-		cur_p = gmtime(&t);
+	cur_p = gmtime(&t);
 #else
-		gmtime_r(&t, &cur);
-		cur_p = &cur;
+	gmtime_r(&t, &cur);
+	cur_p = &cur;
 #endif
-		if (strftime(date, sizeof(date),
-			"%a, %d %b %Y %H:%M:%S GMT", cur_p) != 0) {
-			evhttp_add_header(headers, "Date", date);
-		}
+	len = strftime(date, sizeof(date),
+	    "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", cur_p);
+	if (len == 0)
+		return;
+	if (http != NULL) {
+		memcpy(http->date, date, len);
+		http->date_len = len;
+		http->date_time = t;
 	}
+	evbuffer_add(evcon->output_buffer, date, len);
 }
 
 static void
-evhttp_maybe_add_content_length_header(struct evkeyvalq *headers,
+evhttp_maybe_add_content_length_header(struct evhttp_arena *arena,
+    struct evkeyvalq *headers, const struct evhttp_known *known,
     long content_length)
 {
-	if (evhttp_find_header(headers, "Transfer-Encoding") == NULL &&
-	    evhttp_find_header(headers,	"Content-Length") == NULL) {
+	if (!(known->mask & (1 << EVHTTP_HDR_TRANSFER_ENCODING |
+		    1 << EVHTTP_HDR_CONTENT_LENGTH))) {
 		char len[12];
 		evutil_snprintf(len, sizeof(len), "%ld", content_length);
-		evhttp_add_header(headers, "Content-Length", len);
+		evhttp_add_header_arena(arena, headers, "Content-Length", len);
 	}
 }
 
@@ -459,8 +655,16 @@ static void
 evhttp_make_header_response(struct evhttp_connection *evcon,
     struct evhttp_request *req)
 {
-	int is_keepalive = evhttp_is_connection_keepalive(req->input_headers);
+	struct evhttp_arena *arena = EVHTTP_REQ_ARENA_OF(req);
+	struct evhttp_known in, out;
+	int is_keepalive;
 	char line[1024];
+
+	/* the checks below are bit tests on one pass over each list */
+	evhttp_headers_known(req->input_headers, &in);
+	evhttp_headers_known(req->output_headers, &out);
+	is_keepalive = evhttp_is_connection_keepalive(&in);
+
 	evutil_snprintf(line, sizeof(line), "HTTP/%d.%d %d %s\r\n",
 	    req->major, req->minor, req->response_code,
 	    req->response_code_line);
@@ -468,14 +672,14 @@ evhttp_make_header_response(struct evhttp_connection *evcon,
 
 	if (req->major == 1) {
 		if (req->minor == 1)
-			evhttp_maybe_add_date_header(req->output_headers);
+			evhttp_maybe_add_date_header(evcon, &out);
 
 		/*
 		 * if the protocol is 1.0; and the connection was keep-alive
 		 * we need to add a keep-alive header, too.
 		 */
 		if (req->minor == 0 && is_keepalive)
-			evhttp_add_header(req->output_headers,
+			evhttp_add_header_arena(arena, req->output_headers,
 			    "Connection", "keep-alive");
 
 		if (req->minor == 1 || is_keepalive) {
@@ -484,36 +688,48 @@ evhttp_make_header_response(struct evhttp_connection *evcon,
 			 * user did not give it, this is required for
 			 * persistent connections to work.
 			 */
-			evhttp_maybe_add_content_length_header(
-				req->output_headers,
+			evhttp_maybe_add_content_length_header(arena,
+				req->output_headers, &out,
 				(long)EVBUFFER_LENGTH(req->output_buffer));
 		}
 	}
 
 	/* Potentially add headers for unidentified content. */
 	if (EVBUFFER_LENGTH(req->output_buffer)) {
-		if (evhttp_find_header(req->output_headers,
-			"Content-Type") == NULL) {
-			evhttp_add_header(req->output_headers,
+		if (!(out.mask & (1 << EVHTTP_HDR_CONTENT_TYPE)) &&
+		    (req->header_block == NULL ||
+			!req->header_block->has_content_type)) {
+			evhttp_add_header_arena(arena, req->output_headers,
 			    "Content-Type", "text/html; charset=ISO-8859-1");
 		}
 	}
 
 	/* if the request asked for a close, we send a close, too */
-	if (evhttp_is_connection_close(req->flags, req->input_headers)) {
+	if (evhttp_is_connection_close(req->flags, &in)) {
 		evhttp_remove_header(req->output_headers, "Connection");
 		if (!(req->flags & EVHTTP_PROXY_REQUEST))
-		    evhttp_add_header(req->output_headers, "Connection", "close");
+		    evhttp_add_header_arena(arena, req->output_headers,
+			"Connection", "close");
 		evhttp_remove_header(req->output_headers, "Proxy-Connection");
 	}
 }
 
+/* data appended to output_buffer must follow a pending body */
+static void
+evhttp_join_body(struct evhttp_connection *evcon)
+{
+	if (EVBUFFER_LENGTH(evcon->output_body) > 0)
+		evbuffer_add_buffer(evcon->output_buffer, evcon->output_body);
+}
+
 void
 evhttp_make_header(struct evhttp_connection *evcon, struct evhttp_request *req)
 {
 	char line[1024];
 	struct evkeyval *header;
 
+	evhttp_join_body(evcon);
+
 	/*
 	 * Depending if this is a HTTP request or response, we might need to
 	 * add some new headers or remove existing headers.
@@ -529,14 +745,18 @@ evhttp_make_header(struct evhttp_connection *evcon, struct evhttp_request *req)
 		    header->key, header->value);
 		evbuffer_add(evcon->output_buffer, line, strlen(line));
 	}
+	if (req->header_block != NULL)
+		evbuffer_add(evcon->output_buffer, req->header_block->data,
+		    req->header_block->len);
 	evbuffer_add(evcon->output_buffer, "\r\n", 2);
 
 	if (EVBUFFER_LENGTH(req->output_buffer) > 0) {
 		/*
 		 * For a request, we add the POST data, for a reply, this
-		 * is the regular data.
+		 * is the regular data.  It is kept apart from the headers
+		 * and written with them by one writev.
 		 */
-		evbuffer_add_buffer(evcon->output_buffer, req->output_buffer);
+		evbuffer_add_buffer(evcon->output_body, req->output_buffer);
 	}
 }
 
@@ -615,7 +835,8 @@ evhttp_connection_incoming_fail(struct evhttp_request *req,
 	default:	/* xxx: probably should just error on default */
 		/* the callback looks at the uri to determine errors */
 		if (req->uri) {
-			free(req->uri);
+			if (!(req->flags & EVHTTP_REQ_ARENA))
+				free(req->uri);
 			req->uri = NULL;
 		}
 
@@ -684,7 +905,7 @@ evhttp_write(int fd, short what, void *arg)
 		return;
 	}
 
-	n = evbuffer_write(evcon->output_buffer, fd);
+	n = evbuffer_write_pair(evcon->output_buffer, evcon->output_body, fd);
 	if (n == -1) {
 		event_debug(("%s: evbuffer_write", __func__));
 		evhttp_connection_fail(evcon, EVCON_HTTP_EOF);
@@ -697,7 +918,8 @@ evhttp_write(int fd, short what, void *arg)
 		return;
 	}
 
-	if (EVBUFFER_LENGTH(evcon->output_buffer) != 0) {
+	if (EVBUFFER_LENGTH(evcon->output_buffer) != 0 ||
+	    EVBUFFER_LENGTH(evcon->output_body) != 0) {
 		evhttp_add_event(&evcon->ev, 
 		    evcon->timeout, HTTP_WRITE_TIMEOUT);
 		return;
@@ -724,14 +946,17 @@ evhttp_connection_done(struct evhttp_connection *evcon)
 	if (con_outgoing) {
 		/* idle or close the connection */
 	        int need_close;
+		struct evhttp_known in, out;
 		TAILQ_REMOVE(&evcon->requests, req, next);
 		req->evcon = NULL;
 
 		evcon->state = EVCON_IDLE;
 
+		evhttp_headers_known(req->input_headers, &in);
+		evhttp_headers_known(req->output_headers, &out);
 		need_close = 
-		    evhttp_is_connection_close(req->flags, req->input_headers)||
-		    evhttp_is_connection_close(req->flags, req->output_headers);
+		    evhttp_is_connection_close(req->flags, &in) ||
+		    evhttp_is_connection_close(req->flags, &out);
 
 		/* check if we got asked to close the connection */
 		if (need_close)
@@ -984,6 +1209,7 @@ evhttp_write_connectioncb(struct evhttp_connection *evcon, void *arg)
 void
 evhttp_connection_free(struct evhttp_connection *evcon)
 {
+	struct evhttp *http = evcon->http_server;
 	struct evhttp_request *req;
 
 	/* notify interested parties that this connection is going down */
@@ -998,9 +1224,10 @@ evhttp_connection_free(struct evhttp_connection *evcon)
 		evhttp_request_free(req);
 	}
 
-	if (evcon->http_server != NULL) {
-		struct evhttp *http = evcon->http_server;
+	if (http != NULL) {
 		TAILQ_REMOVE(&http->connections, evcon, next);
+		__atomic_store_n(&http->nactive, http->nactive - 1,
+		    __ATOMIC_RELAXED);
 	}
 
 	if (event_initialized(&evcon->close_ev))
@@ -1015,15 +1242,21 @@ evhttp_connection_free(struct evhttp_connection *evcon)
 	if (evcon->bind_address != NULL)
 		free(evcon->bind_address);
 
-	if (evcon->address != NULL)
+	if (evcon->address != NULL && evcon->address != evcon->host)
 		free(evcon->address);
 
+	if (http != NULL && evhttp_pool_put_connection(http, evcon) == 0)
+		return;
+
 	if (evcon->input_buffer != NULL)
 		evbuffer_free(evcon->input_buffer);
 
 	if (evcon->output_buffer != NULL)
 		evbuffer_free(evcon->output_buffer);
+	if (evcon->output_body != NULL)
+		evbuffer_free(evcon->output_body);
 
+	evhttp_arena_reset(&evcon->arena);
 	free(evcon);
 }
 
@@ -1203,35 +1436,98 @@ evhttp_valid_response_code(int code)
 	return (1);
 }
 
-/* Parses the status line of a web server */
-
+/*
+ * Finds the next line of data from *off without copying it.  A line ends
+ * with LF, a CR before it is not part of the line.  memchr is vectorized
+ * by the C library.
+ *
+ * Returns 1 and moves *off past the line, 0 if the line is incomplete,
+ * -1 on a CR inside the line.
+ */
 static int
-evhttp_parse_response_line(struct evhttp_request *req, char *line)
+evhttp_next_line(const char *data, size_t len, size_t *off,
+    struct evhttp_view *line)
 {
-	char *protocol;
-	char *number;
-	char *readable;
+	const char *start = data + *off;
+	const char *lf;
+	size_t n;
 
-	protocol = strsep(&line, " ");
-	if (line == NULL)
-		return (-1);
-	number = strsep(&line, " ");
-	if (line == NULL)
+	if (*off >= len || (lf = memchr(start, '\n', len - *off)) == NULL)
+		return (0);
+	n = lf - start;
+	if (n > 0 && start[n - 1] == '\r')
+		n--;
+	if (memchr(start, '\r', n) != NULL)
 		return (-1);
-	readable = line;
 
-	if (strcmp(protocol, "HTTP/1.0") == 0) {
+	line->off = *off;
+	line->len = n;
+	*off += lf - start + 1;
+	return (1);
+}
+
+/* splits line at its first n - 1 spaces, the last word is the rest */
+static int
+evhttp_split_line(const char *data, const struct evhttp_view *line,
+    struct evhttp_view *words, int n)
+{
+	size_t off = line->off, end = line->off + line->len;
+	const char *sp;
+	int i;
+
+	for (i = 0; i < n - 1; ++i) {
+		if ((sp = memchr(data + off, ' ', end - off)) == NULL)
+			return (-1);
+		words[i].off = off;
+		words[i].len = sp - (data + off);
+		off = sp - data + 1;
+	}
+	words[i].off = off;
+	words[i].len = end - off;
+	return (0);
+}
+
+#define EVHTTP_VIEW_IS(data, view, str) \
+	((view).len == sizeof(str) - 1 && \
+	    memcmp((data) + (view).off, str, sizeof(str) - 1) == 0)
+
+static int
+evhttp_parse_version(struct evhttp_request *req, const char *data,
+    struct evhttp_view version)
+{
+	if (EVHTTP_VIEW_IS(data, version, "HTTP/1.0")) {
 		req->major = 1;
 		req->minor = 0;
-	} else if (strcmp(protocol, "HTTP/1.1") == 0) {
+	} else if (EVHTTP_VIEW_IS(data, version, "HTTP/1.1")) {
 		req->major = 1;
 		req->minor = 1;
 	} else {
-		event_debug(("%s: bad protocol \"%s\"",
-			__func__, protocol));
+		event_debug(("%s: bad version \"%.*s\" on request %p",
+			__func__, (int)version.len, data + version.off, req));
 		return (-1);
 	}
+	return (0);
+}
+
+/* Parses the status line of a web server */
 
+static int
+evhttp_parse_response_line(struct evhttp_request *req, const char *data,
+    const struct evhttp_view *line)
+{
+	struct evhttp_view words[3];	/* protocol, number, readable */
+	char number[16];
+
+	if (evhttp_split_line(data, line, words, 3) == -1)
+		return (-1);
+
+	if (evhttp_parse_version(req, data, words[0]) == -1)
+		return (-1);
+
+	if (words[1].len >= sizeof(number))
+		return (-1);
+	memcpy(number, data + words[1].off, words[1].len);
+	number[words[1].len] = '\0';
 	req->response_code = atoi(number);
 	if (!evhttp_valid_response_code(req->response_code)) {
 		event_debug(("%s: bad response code \"%s\"",
@@ -1239,7 +1535,9 @@ evhttp_parse_response_line(struct evhttp_request *req, char *line)
 		return (-1);
 	}
 
-	if ((req->response_code_line = strdup(readable)) == NULL)
+	if ((req->response_code_line = evhttp_arena_strndup(
+		    EVHTTP_REQ_ARENA_OF(req), data + words[2].off,
+		    words[2].len)) == NULL)
 		event_err(1, "%s: strdup", __func__);
 
 	return (0);
@@ -1248,49 +1546,36 @@ evhttp_parse_response_line(struct evhttp_request *req, char *line)
 /* Parse the first line of a HTTP request */
 
 static int
-evhttp_parse_request_line(struct evhttp_request *req, char *line)
+evhttp_parse_request_line(struct evhttp_request *req, const char *data,
+    const struct evhttp_view *line)
 {
-	char *method;
-	char *uri;
-	char *version;
+	struct evhttp_view words[3];	/* method, uri, version */
 
 	/* Parse the request line */
-	method = strsep(&line, " ");
-	if (line == NULL)
-		return (-1);
-	uri = strsep(&line, " ");
-	if (line == NULL)
-		return (-1);
-	version = strsep(&line, " ");
-	if (line != NULL)
+	if (evhttp_split_line(data, line, words, 3) == -1 ||
+	    memchr(data + words[2].off, ' ', words[2].len) != NULL)
 		return (-1);
 
 	/* First line */
-	if (strcmp(method, "GET") == 0) {
+	if (EVHTTP_VIEW_IS(data, words[0], "GET")) {
 		req->type = EVHTTP_REQ_GET;
-	} else if (strcmp(method, "POST") == 0) {
+	} else if (EVHTTP_VIEW_IS(data, words[0], "POST")) {
 		req->type = EVHTTP_REQ_POST;
-	} else if (strcmp(method, "HEAD") == 0) {
+	} else if (EVHTTP_VIEW_IS(data, words[0], "HEAD")) {
 		req->type = EVHTTP_REQ_HEAD;
 	} else {
-		event_debug(("%s: bad method %s on request %p from %s",
-			__func__, method, req, req->remote_host));
+		event_debug(("%s: bad method %.*s on request %p from %s",
+			__func__, (int)words[0].len, data + words[0].off,
+			req, req->remote_host));
 		return (-1);
 	}
 
-	if (strcmp(version, "HTTP/1.0") == 0) {
-		req->major = 1;
-		req->minor = 0;
-	} else if (strcmp(version, "HTTP/1.1") == 0) {
-		req->major = 1;
-		req->minor = 1;
-	} else {
-		event_debug(("%s: bad version %s on request %p from %s",
-			__func__, version, req, req->remote_host));
+	if (evhttp_parse_version(req, data, words[2]) == -1)
 		return (-1);
-	}
 
-	if ((req->uri = strdup(uri)) == NULL) {
+	/* the only string of the line the handler gets */
+	if ((req->uri = evhttp_arena_strndup(EVHTTP_REQ_ARENA_OF(req),
+		    data + words[1].off, words[1].len)) == NULL) {
 		event_debug(("%s: evhttp_decode_uri", __func__));
 		return (-1);
 	}
@@ -1302,19 +1587,42 @@ evhttp_parse_request_line(struct evhttp_request *req, char *line)
 	return (0);
 }
 
-const char *
-evhttp_find_header(const struct evkeyvalq *headers, const char *key)
+/* the first header of key, strcasecmp only runs on equal hashes */
+static struct evkeyval *
+evhttp_lookup_header(const struct evkeyvalq *headers, const char *key)
 {
 	struct evkeyval *header;
+	unsigned int hash = evhttp_header_hash(key, strlen(key));
 
 	TAILQ_FOREACH(header, headers, next) {
-		if (strcasecmp(header->key, key) == 0)
-			return (header->value);
+		if (header->hash == 0)
+			evhttp_header_classify(header);
+		if (header->hash == hash && strcasecmp(header->key, key) == 0)
+			return (header);
 	}
 
 	return (NULL);
 }
 
+const char *
+evhttp_find_header(const struct evkeyvalq *headers, const char *key)
+{
+	struct evkeyval *header = evhttp_lookup_header(headers, key);
+
+	return (header != NULL ? header->value : NULL);
+}
+
+static void
+evhttp_free_header(struct evkeyval *header)
+{
+	/* arena headers go away with the arena */
+	if (header->flags & EVKEYVAL_ARENA)
+		return;
+	free(header->key);
+	free(header->value);
+	free(header);
+}
+
 void
 evhttp_clear_headers(struct evkeyvalq *headers)
 {
@@ -1324,9 +1632,7 @@ evhttp_clear_headers(struct evkeyvalq *headers)
 	    header != NULL;
 	    header = TAILQ_FIRST(headers)) {
 		TAILQ_REMOVE(headers, header, next);
-		free(header->key);
-		free(header->value);
-		free(header);
+		evhttp_free_header(header);
 	}
 }
 
@@ -1338,21 +1644,14 @@ evhttp_clear_headers(struct evkeyvalq *headers)
 int
 evhttp_remove_header(struct evkeyvalq *headers, const char *key)
 {
-	struct evkeyval *header;
-
-	TAILQ_FOREACH(header, headers, next) {
-		if (strcasecmp(header->key, key) == 0)
-			break;
-	}
+	struct evkeyval *header = evhttp_lookup_header(headers, key);
 
 	if (header == NULL)
 		return (-1);
 
 	/* Free and remove the header that we found */
 	TAILQ_REMOVE(headers, header, next);
-	free(header->key);
-	free(header->value);
-	free(header);
+	evhttp_free_header(header);
 
 	return (0);
 }
@@ -1361,8 +1660,14 @@ int
 evhttp_add_header(struct evkeyvalq *headers,
     const char *key, const char *value)
 {
-	struct evkeyval *header = NULL;
+	return (evhttp_add_header_arena(NULL, headers, key, value));
+}
 
+/* adds a header allocated from arena, or malloced if arena is NULL */
+static int
+evhttp_add_header_arena(struct evhttp_arena *arena,
+    struct evkeyvalq *headers, const char *key, const char *value)
+{
 	event_debug(("%s: key: %s val: %s\n", __func__, key, value));
 
 	if (strchr(value, '\r') != NULL || strchr(value, '\n') != NULL ||
@@ -1372,22 +1677,54 @@ evhttp_add_header(struct evkeyvalq *headers,
 		return (-1);
 	}
 
-	header = calloc(1, sizeof(struct evkeyval));
-	if (header == NULL) {
-		event_warn("%s: calloc", __func__);
-		return (-1);
-	}
-	if ((header->key = strdup(key)) == NULL) {
-		free(header);
-		event_warn("%s: strdup", __func__);
-		return (-1);
-	}
-	if ((header->value = strdup(value)) == NULL) {
-		free(header->key);
-		free(header);
-		event_warn("%s: strdup", __func__);
-		return (-1);
+	return (evhttp_add_header_view(arena, headers,
+		key, strlen(key), value, strlen(value)));
+}
+
+/* adds a header from strings that are not terminated, e.g. of a buffer */
+static int
+evhttp_add_header_view(struct evhttp_arena *arena, struct evkeyvalq *headers,
+    const char *key, size_t key_len, const char *value, size_t value_len)
+{
+	struct evkeyval *header = NULL;
+
+	if (arena != NULL) {
+		/* one allocation for the node and both strings */
+		header = evhttp_arena_alloc(arena,
+		    sizeof(struct evkeyval) + key_len + value_len + 2);
+		if (header == NULL) {
+			event_warn("%s: evhttp_arena_alloc", __func__);
+			return (-1);
+		}
+		header->key = (char *)(header + 1);
+		header->value = header->key + key_len + 1;
+		header->flags = EVKEYVAL_ARENA;
+		memcpy(header->key, key, key_len);
+		header->key[key_len] = '\0';
+		memcpy(header->value, value, value_len);
+		header->value[value_len] = '\0';
+	} else {
+		header = calloc(1, sizeof(struct evkeyval));
+		if (header == NULL) {
+			event_warn("%s: calloc", __func__);
+			return (-1);
+		}
+		if ((header->key = evhttp_arena_strndup(NULL,
+			 key, key_len)) == NULL) {
+			free(header);
+			event_warn("%s: strdup", __func__);
+			return (-1);
+		}
+		if ((header->value = evhttp_arena_strndup(NULL,
+			 value, value_len)) == NULL) {
+			free(header->key);
+			free(header);
+			event_warn("%s: strdup", __func__);
+			return (-1);
+		}
 	}
+	header->hash = evhttp_header_hash(key, key_len);
+	header->id = evhttp_header_id(key, key_len);
 
 	TAILQ_INSERT_TAIL(headers, header, next);
 
@@ -1407,48 +1744,65 @@ evhttp_add_header(struct evkeyvalq *headers,
 enum message_read_status
 evhttp_parse_firstline(struct evhttp_request *req, struct evbuffer *buffer)
 {
-	char *line;
+	const char *data;
+	struct evhttp_view line;
+	size_t off = 0;
 	enum message_read_status status = ALL_DATA_READ;
 
-	line = evbuffer_readline(buffer);
-	if (line == NULL)
+	/* the line is parsed in the buffer and drained afterwards */
+	if (EVBUFFER_LENGTH(buffer) == 0)
+		return (MORE_DATA_EXPECTED);
+	data = (const char *)EVBUFFER_DATA(buffer);
+	switch (evhttp_next_line(data, EVBUFFER_LENGTH(buffer), &off, &line)) {
+	case 0:
 		return (MORE_DATA_EXPECTED);
+	case -1:
+		return (DATA_CORRUPTED);
+	}
 
 	switch (req->kind) {
 	case EVHTTP_REQUEST:
-		if (evhttp_parse_request_line(req, line) == -1)
+		if (evhttp_parse_request_line(req, data, &line) == -1)
 			status = DATA_CORRUPTED;
 		break;
 	case EVHTTP_RESPONSE:
-		if (evhttp_parse_response_line(req, line) == -1)
+		if (evhttp_parse_response_line(req, data, &line) == -1)
 			status = DATA_CORRUPTED;
 		break;
 	default:
 		status = DATA_CORRUPTED;
 	}
 
-	free(line);
+	evbuffer_drain(buffer, off);
 	return (status);
 }
 
 static int
-evhttp_append_to_last_header(struct evkeyvalq *headers, const char *line)
+evhttp_append_to_last_header(struct evhttp_arena *arena,
+    struct evkeyvalq *headers, const char *line, size_t line_len)
 {
 	struct evkeyval *header = TAILQ_LAST(headers, evkeyvalq);
 	char *newval;
-	size_t old_len, line_len;
+	size_t old_len;
 
 	if (header == NULL)
 		return (-1);
 
 	old_len = strlen(header->value);
-	line_len = strlen(line);
 
-	newval = realloc(header->value, old_len + line_len + 1);
-	if (newval == NULL)
-		return (-1);
+	if (header->flags & EVKEYVAL_ARENA) {
+		newval = evhttp_arena_alloc(arena, old_len + line_len + 1);
+		if (newval == NULL)
+			return (-1);
+		memcpy(newval, header->value, old_len);
+	} else {
+		newval = realloc(header->value, old_len + line_len + 1);
+		if (newval == NULL)
+			return (-1);
+	}
 
-	memcpy(newval + old_len, line, line_len + 1);
+	memcpy(newval + old_len, line, line_len);
+	newval[old_len + line_len] = '\0';
 	header->value = newval;
 
 	return (0);
@@ -1457,58 +1811,68 @@ evhttp_append_to_last_header(struct evkeyvalq *headers, const char *line)
 enum message_read_status
 evhttp_parse_headers(struct evhttp_request *req, struct evbuffer* buffer)
 {
-	char *line;
+	const char *data;
+	struct evhttp_view line;
+	size_t len, off = 0;
+	int res;
 	enum message_read_status status = MORE_DATA_EXPECTED;
 
+	struct evhttp_arena *arena = EVHTTP_REQ_ARENA_OF(req);
 	struct evkeyvalq* headers = req->input_headers;
-	while ((line = evbuffer_readline(buffer))
-	       != NULL) {
-		char *skey, *svalue;
 
-		if (*line == '\0') { /* Last header - Done */
+	/* complete lines are parsed in the buffer, then drained at once */
+	if ((len = EVBUFFER_LENGTH(buffer)) == 0)
+		return (MORE_DATA_EXPECTED);
+	data = (const char *)EVBUFFER_DATA(buffer);
+	while ((res = evhttp_next_line(data, len, &off, &line)) == 1) {
+		const char *p = data + line.off;
+		const char *colon;
+		size_t key_len;
+
+		if (line.len == 0) { /* Last header - Done */
 			status = ALL_DATA_READ;
-			free(line);
 			break;
 		}
 
 		/* Check if this is a continuation line */
-		if (*line == ' ' || *line == '\t') {
-			if (evhttp_append_to_last_header(headers, line) == -1)
+		if (*p == ' ' || *p == '\t') {
+			if (evhttp_append_to_last_header(arena, headers,
+				p, line.len) == -1)
 				goto error;
-			free(line);
 			continue;
 		}
 
 		/* Processing of header lines */
-		svalue = line;
-		skey = strsep(&svalue, ":");
-		if (svalue == NULL)
+		if ((colon = memchr(p, ':', line.len)) == NULL)
 			goto error;
+		key_len = colon - p;
+		for (++colon; colon < p + line.len && *colon == ' '; ++colon)
+			;
 
-		svalue += strspn(svalue, " ");
-
-		if (evhttp_add_header(headers, skey, svalue) == -1)
+		if (evhttp_add_header_view(arena, headers, p, key_len,
+			colon, p + line.len - colon) == -1)
 			goto error;
-
-		free(line);
 	}
+	if (res == -1)
+		goto error;
 
+	evbuffer_drain(buffer, off);
 	return (status);
 
  error:
-	free(line);
+	evbuffer_drain(buffer, off);
 	return (DATA_CORRUPTED);
 }
 
 static int
-evhttp_get_body_length(struct evhttp_request *req)
+evhttp_get_body_length(struct evhttp_request *req,
+    const struct evhttp_known *in)
 {
-	struct evkeyvalq *headers = req->input_headers;
 	const char *content_length;
 	const char *connection;
 
-	content_length = evhttp_find_header(headers, "Content-Length");
-	connection = evhttp_find_header(headers, "Connection");
+	content_length = EVHTTP_KNOWN(in, EVHTTP_HDR_CONTENT_LENGTH);
+	connection = EVHTTP_KNOWN(in, EVHTTP_HDR_CONNECTION);
 		
 	if (content_length == NULL && connection == NULL)
 		req->ntoread = -1;
@@ -1542,6 +1906,7 @@ evhttp_get_body_length(struct evhttp_request *req)
 static void
 evhttp_get_body(struct evhttp_connection *evcon, struct evhttp_request *req)
 {
+	struct evhttp_known in;
 	const char *xfer_enc;
 	
 	/* If this is a request without a body, then we are done */
@@ -1550,12 +1915,13 @@ evhttp_get_body(struct evhttp_connection *evcon, struct evhttp_request *req)
 		return;
 	}
 	evcon->state = EVCON_READING_BODY;
-	xfer_enc = evhttp_find_header(req->input_headers, "Transfer-Encoding");
+	evhttp_headers_known(req->input_headers, &in);
+	xfer_enc = EVHTTP_KNOWN(&in, EVHTTP_HDR_TRANSFER_ENCODING);
 	if (xfer_enc != NULL && strcasecmp(xfer_enc, "chunked") == 0) {
 		req->chunked = 1;
 		req->ntoread = -1;
 	} else {
-		if (evhttp_get_body_length(req) == -1) {
+		if (evhttp_get_body_length(req, &in) == -1) {
 			evhttp_connection_fail(evcon,
 			    EVCON_HTTP_INVALID_HEADER);
 			return;
@@ -1678,9 +2044,15 @@ evhttp_connection_new(const char *address, unsigned short port)
 		event_warn("%s: evbuffer_new failed", __func__);
 		goto error;
 	}
+
+	if ((evcon->output_body = evbuffer_new()) == NULL) {
+		event_warn("%s: evbuffer_new failed", __func__);
+		goto error;
+	}
 	
 	evcon->state = EVCON_DISCONNECTED;
 	TAILQ_INIT(&evcon->requests);
+	evhttp_arena_init(&evcon->arena);
 
 	return (evcon);
 	
@@ -1830,17 +2202,19 @@ static void
 evhttp_send_done(struct evhttp_connection *evcon, void *arg)
 {
 	int need_close;
+	struct evhttp_known in, out;
 	struct evhttp_request *req = TAILQ_FIRST(&evcon->requests);
 	TAILQ_REMOVE(&evcon->requests, req, next);
 
 	/* delete possible close detection events */
 	evhttp_connection_stop_detectclose(evcon);
 	
+	evhttp_headers_known(req->input_headers, &in);
+	evhttp_headers_known(req->output_headers, &out);
 	need_close =
-	    (req->minor == 0 &&
-		!evhttp_is_connection_keepalive(req->input_headers))||
-	    evhttp_is_connection_close(req->flags, req->input_headers) ||
-	    evhttp_is_connection_close(req->flags, req->output_headers);
+	    (req->minor == 0 && !evhttp_is_connection_keepalive(&in)) ||
+	    evhttp_is_connection_close(req->flags, &in) ||
+	    evhttp_is_connection_close(req->flags, &out);
 
 	assert(req->flags & EVHTTP_REQ_OWN_CONNECTION);
 	evhttp_request_free(req);
@@ -1872,7 +2246,8 @@ evhttp_send_error(struct evhttp_request *req, int error, const char *reason)
 	struct evbuffer *buf = evbuffer_new();
 
 	/* close the connection on error */
-	evhttp_add_header(req->output_headers, "Connection", "close");
+	evhttp_add_header_arena(EVHTTP_REQ_ARENA_OF(req), req->output_headers,
+	    "Connection", "close");
 
 	evhttp_response_code(req, error, reason);
 
@@ -1919,8 +2294,8 @@ evhttp_send_reply_start(struct evhttp_request *req, int code,
 	evhttp_response_code(req, code, reason);
 	if (req->major == 1 && req->minor == 1) {
 		/* use chunked encoding for HTTP/1.1 */
-		evhttp_add_header(req->output_headers, "Transfer-Encoding",
-		    "chunked");
+		evhttp_add_header_arena(EVHTTP_REQ_ARENA_OF(req),
+		    req->output_headers, "Transfer-Encoding", "chunked");
 		req->chunked = 1;
 	}
 	evhttp_make_header(req->evcon, req);
@@ -1930,15 +2305,27 @@ evhttp_send_reply_start(struct evhttp_request *req, int code,
 void
 evhttp_send_reply_chunk(struct evhttp_request *req, struct evbuffer *databuf)
 {
-	if (req->chunked) {
+	evhttp_send_reply_chunk_with_cb(req, databuf, NULL, NULL);
+}
+
+void
+evhttp_send_reply_chunk_with_cb(struct evhttp_request *req,
+    struct evbuffer *databuf,
+    void (*cb)(struct evhttp_connection *, void *), void *arg)
+{
+	/* an empty chunk would end the reply */
+	int chunked = req->chunked && EVBUFFER_LENGTH(databuf) != 0;
+
+	evhttp_join_body(req->evcon);
+	if (chunked) {
 		evbuffer_add_printf(req->evcon->output_buffer, "%x\r\n",
 				    (unsigned)EVBUFFER_LENGTH(databuf));
 	}
 	evbuffer_add_buffer(req->evcon->output_buffer, databuf);
-	if (req->chunked) {
+	if (chunked) {
 		evbuffer_add(req->evcon->output_buffer, "\r\n", 2);
 	}
-	evhttp_write_buffer(req->evcon, NULL, NULL);
+	evhttp_write_buffer(req->evcon, cb, arg);
 }
 
 void
@@ -1947,6 +2334,7 @@ evhttp_send_reply_end(struct evhttp_request *req)
 	struct evhttp_connection *evcon = req->evcon;
 
 	if (req->chunked) {
+		evhttp_join_body(evcon);
 		evbuffer_add(req->evcon->output_buffer, "0\r\n\r\n", 5);
 		evhttp_write_buffer(req->evcon, evhttp_send_done, NULL);
 		req->chunked = 0;
@@ -1960,14 +2348,82 @@ evhttp_send_reply_end(struct evhttp_request *req)
 	}
 }
 
+/* headers the library sets per message */
+static const char *evhttp_managed_headers[] = {
+	"Date", "Content-Length", "Transfer-Encoding", "Connection",
+	"Proxy-Connection", NULL
+};
+
+struct evhttp_header_block *
+evhttp_header_block_new(const char *data)
+{
+	struct evhttp_header_block *block;
+	const char *line, *colon, *eol;
+	int has_content_type = 0;
+	const char **managed;
+	size_t len;
+
+	for (line = data; *line != '\0'; line = eol + 2) {
+		len = strcspn(line, "\r\n");
+		eol = line + len;
+		colon = memchr(line, ':', len);
+		if (eol[0] != '\r' || eol[1] != '\n' || colon == NULL ||
+		    colon == line) {
+			event_warnx("%s: malformed header line", __func__);
+			return (NULL);
+		}
+		len = colon - line;
+		for (managed = evhttp_managed_headers; *managed; ++managed) {
+			if (strlen(*managed) == len &&
+			    strncasecmp(line, *managed, len) == 0) {
+				event_warnx("%s: %s is set per message",
+				    __func__, *managed);
+				return (NULL);
+			}
+		}
+		if (len == 12 && strncasecmp(line, "Content-Type", len) == 0)
+			has_content_type = 1;
+	}
+
+	if ((block = calloc(1, sizeof(struct evhttp_header_block))) == NULL) {
+		event_warn("%s: calloc", __func__);
+		return (NULL);
+	}
+	if ((block->data = strdup(data)) == NULL) {
+		event_warn("%s: strdup", __func__);
+		free(block);
+		return (NULL);
+	}
+	block->len = strlen(data);
+	block->has_content_type = has_content_type;
+
+	return (block);
+}
+
+void
+evhttp_header_block_free(struct evhttp_header_block *block)
+{
+	free(block->data);
+	free(block);
+}
+
+void
+evhttp_set_header_block(struct evhttp_request *req,
+    const struct evhttp_header_block *block)
+{
+	req->header_block = block;
+}
+
 void
 evhttp_response_code(struct evhttp_request *req, int code, const char *reason)
 {
 	req->kind = EVHTTP_RESPONSE;
 	req->response_code = code;
-	if (req->response_code_line != NULL)
+	if (req->response_code_line != NULL &&
+	    !(req->flags & EVHTTP_REQ_ARENA))
 		free(req->response_code_line);
-	req->response_code_line = strdup(reason);
+	req->response_code_line =
+	    evhttp_arena_strdup(EVHTTP_REQ_ARENA_OF(req), reason);
 }
 
 void
@@ -1982,8 +2438,11 @@ evhttp_send_page(struct evhttp_request *req, struct evbuffer *databuf)
 		evhttp_response_code(req, 200, "OK");
 
 	evhttp_clear_headers(req->output_headers);
-	evhttp_add_header(req->output_headers, "Content-Type", "text/html");
-	evhttp_add_header(req->output_headers, "Connection", "close");
+	req->header_block = NULL;
+	evhttp_add_header_arena(EVHTTP_REQ_ARENA_OF(req), req->output_headers,
+	    "Content-Type", "text/html");
+	evhttp_add_header_arena(EVHTTP_REQ_ARENA_OF(req), req->output_headers,
+	    "Connection", "close");
 
 	evhttp_send(req, databuf);
 }
@@ -2184,62 +2643,346 @@ evhttp_handle_request(struct evhttp_request *req, void *arg)
 	}
 }
 
-static void
-new_worker_task(struct evhttp * http, int fd, struct sockaddr_storage * ss)
+/*
+ * Worker task ring: a bounded multi-producer single-consumer queue,
+ * every slot has a sequence number telling whether it is free for the
+ * push at that position or holds the task for the pop at it.
+ */
+static int
+worker_tasks_init(struct taskq * q)
 {
-	struct task * task = calloc(1, sizeof(struct task));
-	task->ss = *ss;
+	unsigned int i;
+
+	q->ring = calloc(EVHTTP_TASKS, sizeof(struct task));
+	if (q->ring == NULL)
+		return (-1);
+	for (i = 0; i < EVHTTP_TASKS; ++i)
+		q->ring[i].seq = i;
+	q->head = q->tail = 0;
+	return (0);
+}
+
+/* returns -1 if the ring is full */
+static int
+worker_task_push(struct evhttp * http, int fd,
+    struct sockaddr_storage * ss, socklen_t addrlen)
+{
+	struct taskq * q = &http->tasks;
+	struct task * task;
+	unsigned int pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	int dif;
+
+	for (;;) {
+		task = &q->ring[pos & (EVHTTP_TASKS - 1)];
+		dif = (int)(__atomic_load_n(&task->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return (-1);
+		} else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+
 	task->fd = fd;
+	memcpy(&task->ss, ss, addrlen);
+	__atomic_store_n(&task->seq, pos + 1, __ATOMIC_RELEASE);
+	return (0);
+}
+
+/* returns -1 if the ring is empty */
+static int
+worker_task_pop(struct evhttp * http, int * fd, struct sockaddr_storage * ss)
+{
+	struct taskq * q = &http->tasks;
+	struct task * task = &q->ring[q->head & (EVHTTP_TASKS - 1)];
+
+	if (__atomic_load_n(&task->seq, __ATOMIC_ACQUIRE) != q->head + 1)
+		return (-1);
+
+	*fd = task->fd;
+	*ss = task->ss;
+	__atomic_store_n(&task->seq, q->head + EVHTTP_TASKS, __ATOMIC_RELEASE);
+	/* a head seen by the accepting thread comes with its free slot */
+	__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+	return (0);
+}
+
+/* whether a ring of the workers has a free slot; only the accepting
+ * thread pushes, so the slot is still free when it pushes */
+static int
+workers_have_room(struct evhttp * http)
+{
+	struct evhttp * worker = http->cur;
+
+	do {
+		struct taskq * q = &worker->tasks;
+		unsigned int queued = __atomic_load_n(&q->tail, __ATOMIC_RELAXED) -
+		    __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+		if (queued < EVHTTP_TASKS)
+			return (1);
+		worker = worker->next;
+	} while (worker != http->cur);
+	return (0);
+}
 
-	pthread_mutex_lock(&http->lock);
-	TAILQ_INSERT_TAIL(&http->tasks, task, next);
-	pthread_mutex_unlock(&http->lock);
+/* connections of a worker: open ones and ones waiting in its ring */
+static int
+worker_load(struct evhttp * worker)
+{
+	struct taskq * q = &worker->tasks;
+	unsigned int queued = __atomic_load_n(&q->tail, __ATOMIC_RELAXED) -
+	    __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+	return (__atomic_load_n(&worker->nactive, __ATOMIC_RELAXED) +
+	    (int)queued);
+}
+
+/* one wakeup for all tasks pushed to the worker since the last one */
+static void
+wakeup_worker(struct evhttp * worker)
+{
+#ifdef HAVE_EVENTFD
+	uint64_t one = 1;
+	(void)write(worker->wakeup, &one, sizeof(one));
+#else
+	/* a full pipe already wakes the worker up */
+	(void)write(worker->wakeup, "", 1);
+#endif
+	worker->pending = 0;
 }
 
 static void
 notify_worker(int fd, short ev, void * arg)
 {
 	struct evhttp * http = arg;
-	struct task * task;
-	char byte;
-	if (read(fd, &byte, 1) != 1) {
-		/* ignore */
+	struct sockaddr_storage ss;
+	int nfd;
+#ifdef HAVE_EVENTFD
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
 		return;
+#else
+	char bytes[64];
+
+	while (read(fd, bytes, sizeof(bytes)) == sizeof(bytes))
+		;
+#endif
+
+	/* tasks pushed before the wakeup are visible now */
+	while (worker_task_pop(http, &nfd, &ss) == 0) {
+		evhttp_get_request(http, nfd, (struct sockaddr *)&ss,
+		    sizeof(struct sockaddr_storage));
+	}
+}
+
+static struct evhttp *
+least_loaded_worker(struct evhttp *http)
+{
+	struct evhttp *worker = http->next, *best = worker;
+	int load, min = worker_load(worker);
+
+	while ((worker = worker->next) != http->next) {
+		if ((load = worker_load(worker)) < min) {
+			min  = load;
+			best = worker;
+		}
 	}
+	return (best);
+}
 
-	pthread_mutex_lock(&http->lock);
-	task = TAILQ_FIRST(&http->tasks);
-	TAILQ_REMOVE(&http->tasks, task, next);
-	pthread_mutex_unlock(&http->lock);
+static struct evhttp *
+nth_worker(struct evhttp *http, unsigned int n)
+{
+	struct evhttp *worker = http->next;
+
+	while (n--)
+		worker = worker->next;
+	return (worker);
+}
+
+static int
+count_workers(struct evhttp *http)
+{
+	struct evhttp *worker = http->next;
+	int n = 0;
 
-	evhttp_get_request(http, task->fd, (struct sockaddr *)&(task->ss), 
-			sizeof(struct sockaddr_storage));
-	free(task);
+	if (worker == NULL)
+		return (0);
+	do {
+		n++;
+		worker = worker->next;
+	} while (worker != http->next);
+	return (n);
+}
+
+/* the less loaded of two random workers */
+static struct evhttp *
+two_choices_worker(struct evhttp *http)
+{
+	struct evhttp *a, *b;
+	unsigned int n = count_workers(http);
+
+	/* xorshift32 */
+	http->seed ^= http->seed << 13;
+	http->seed ^= http->seed >> 17;
+	http->seed ^= http->seed << 5;
+	a = nth_worker(http, http->seed % n);
+	b = nth_worker(http, (http->seed >> 16) % n);
+	return (worker_load(b) < worker_load(a) ? b : a);
+}
+
+/* the worker on the CPU that received the connection */
+static struct evhttp *
+cpu_worker(struct evhttp *http, int nfd)
+{
+#ifdef SO_INCOMING_CPU
+	struct evhttp *worker = http->next;
+	socklen_t len = sizeof(int);
+	int cpu, explicit = 0;
+
+	if (getsockopt(nfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+	    cpu >= 0) {
+		do {
+			if (worker->cpu == cpu)
+				return (worker);
+			if (worker->cpu != -1)
+				explicit = 1;
+			worker = worker->next;
+		} while (worker != http->next);
+		/* workers without CPUs: the one with the same number */
+		if (!explicit)
+			return (nth_worker(http, cpu % count_workers(http)));
+	}
+#endif
+	return (least_loaded_worker(http));
+}
+
+/* passes a connection to the worker chosen by the dispatch policy, or
+ * to the next one with room in its ring */
+static void
+dispatch_socket(struct evhttp *http, int nfd, struct sockaddr_storage *ss,
+    socklen_t addrlen)
+{
+	struct evhttp *worker, *first;
+
+	switch (http->dispatch) {
+	case EVHTTP_DISPATCH_LEAST_CONN:
+		first = least_loaded_worker(http);
+		break;
+	case EVHTTP_DISPATCH_TWO_CHOICES:
+		first = two_choices_worker(http);
+		break;
+	case EVHTTP_DISPATCH_CPU:
+		first = cpu_worker(http, nfd);
+		break;
+	default:
+		first = http->cur;
+		break;
+	}
+
+	worker = first;
+	do {
+		if (worker_task_push(worker, nfd, ss, addrlen) == 0) {
+			/* a long burst does not wait for the end of the loop */
+			if (++worker->pending >= EVHTTP_TASKS_WAKEUP)
+				wakeup_worker(worker);
+			http->cur = worker->next;
+			return;
+		}
+		worker = worker->next;
+	} while (worker != first);
+
+	/* not reached, accept_socket only accepts with room in a ring */
+	event_errx(1, "%s: rings of all workers are full", __func__);
+}
+
+static void
+resume_accept(int fd, short what, void *arg)
+{
+	struct evhttp *http = arg;
+	struct evhttp_bound_socket *bound;
+
+	TAILQ_FOREACH(bound, &http->sockets, next)
+		event_add(&bound->bind_ev, NULL);
+}
+
+/* stops accepting for EVHTTP_ACCEPT_PAUSE ms, new connections wait in
+ * the backlog of the kernel meanwhile */
+static void
+pause_accept(struct evhttp *http)
+{
+	struct evhttp_bound_socket *bound;
+	struct timeval tv;
+
+	if (evtimer_pending(&http->accept_pause, NULL))
+		return;
+	event_debug(("%s: rings of all workers are full", __func__));
+	TAILQ_FOREACH(bound, &http->sockets, next)
+		event_del(&bound->bind_ev);
+
+	evutil_timerclear(&tv);
+	tv.tv_usec = EVHTTP_ACCEPT_PAUSE * 1000;
+	evtimer_set(&http->accept_pause, resume_accept, http);
+	EVHTTP_BASE_SET(http, &http->accept_pause);
+	evtimer_add(&http->accept_pause, &tv);
 }
 
 static void
 accept_socket(int fd, short what, void *arg)
 {
 	struct evhttp *http = arg;
+	struct evhttp *worker;
 	struct sockaddr_storage ss;
-	socklen_t addrlen = sizeof(ss);
+	socklen_t addrlen;
 	int nfd;
 
-	if ((nfd = accept(fd, (struct sockaddr *)&ss, &addrlen)) == -1) {
-		if (errno != EAGAIN && errno != EINTR)
-			event_warn("%s: bad accept", __func__);
-		return;
+	/* take the backlog in one wakeup, as far as the workers have room */
+	for (;;) {
+		if (http->cur && !workers_have_room(http)) {
+			pause_accept(http);
+			break;
+		}
+		addrlen = sizeof(ss);
+#ifdef HAVE_ACCEPT4
+		nfd = accept4(fd, (struct sockaddr *)&ss, &addrlen,
+		    SOCK_NONBLOCK);
+#else
+		nfd = accept(fd, (struct sockaddr *)&ss, &addrlen);
+#endif
+		if (nfd == -1) {
+			/* an aborted connection is not the end of the backlog */
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				event_warn("%s: bad accept", __func__);
+			break;
+		}
+#ifndef HAVE_ACCEPT4
+		if (evutil_make_socket_nonblocking(nfd) < 0) {
+			EVUTIL_CLOSESOCKET(nfd);
+			continue;
+		}
+#endif
+
+		if (!http->cur)
+			evhttp_get_request(http, nfd,
+			    (struct sockaddr *)&ss, addrlen);
+		else
+			dispatch_socket(http, nfd, &ss, addrlen);
 	}
-	if (evutil_make_socket_nonblocking(nfd) < 0)
-		return;
 
-	if (!http->cur) {
-		evhttp_get_request(http, nfd, (struct sockaddr *)&ss, addrlen);
-	} else {
-		/* send it to a worker thread */
-		new_worker_task(http->cur, nfd, &ss);
-		write(http->cur->wakeup, "", 1);
-		http->cur = http->cur->next;
+	if (http->cur) {
+		worker = http->next;
+		do {
+			if (worker->pending)
+				wakeup_worker(worker);
+			worker = worker->next;
+		} while (worker != http->next);
 	}
 }
 
@@ -2249,7 +2992,7 @@ evhttp_bind_socket(struct evhttp *http, const char *address, u_short port)
 	int fd;
 	int res;
 
-	if ((fd = bind_socket(address, port, 1 /*reuse*/)) == -1)
+	if ((fd = bind_socket(address, port, BIND_REUSEADDR)) == -1)
 		return (-1);
 
 	if (listen(fd, 128) == -1) {
@@ -2267,6 +3010,74 @@ evhttp_bind_socket(struct evhttp *http, const char *address, u_short port)
 	return (res);
 }
 
+int
+evhttp_bind_socket_reuseport(struct evhttp *http, const char *address,
+    u_short port)
+{
+#ifdef SO_REUSEPORT
+	struct evhttp *worker;
+	int *fds;
+	int nfds = 0, n = 0, i;
+
+	/* one listener per worker, or the server itself without workers */
+	worker = http->next ? http->next : http;
+	do {
+		nfds++;
+		worker = worker->next;
+	} while (worker != NULL && worker != http->next);
+
+	if ((fds = calloc(nfds, sizeof(int))) == NULL)
+		return (-1);
+
+	for (n = 0; n < nfds; ++n) {
+		fds[n] = bind_socket(address, port,
+		    BIND_REUSEADDR | BIND_REUSEPORT);
+		if (fds[n] == -1)
+			goto fail;
+		if (listen(fds[n], 128) == -1) {
+			event_warn("%s: listen", __func__);
+			EVUTIL_CLOSESOCKET(fds[n]);
+			goto fail;
+		}
+	}
+
+	/* the kernel balances connections between the listeners,
+	 * each worker accepts on its own base */
+	worker = http->next ? http->next : http;
+	for (i = 0; i < nfds; ++i) {
+		if (evhttp_accept_socket(worker, fds[i]) == -1)
+			goto unaccept;
+		worker = worker->next;
+	}
+
+	free(fds);
+	event_debug(("Bound %d listeners to port %d", nfds, port));
+	return (0);
+
+unaccept:
+	/* each previous worker got its listener last */
+	worker = http->next ? http->next : http;
+	for (n = 0; n < i; ++n) {
+		struct evhttp_bound_socket *bound =
+		    TAILQ_LAST(&worker->sockets, boundq);
+
+		TAILQ_REMOVE(&worker->sockets, bound, next);
+		event_del(&bound->bind_ev);
+		free(bound);
+		worker = worker->next;
+	}
+	n = nfds;
+fail:
+	/* nothing bound by this call is left listening */
+	for (i = 0; i < n; ++i)
+		EVUTIL_CLOSESOCKET(fds[i]);
+	free(fds);
+	return (-1);
+#else
+	return (-1);
+#endif
+}
+
 int
 evhttp_accept_socket(struct evhttp *http, int fd)
 {
@@ -2307,13 +3118,15 @@ evhttp_new_object(void)
 	}
 
 	http->timeout = -1;
+	http->dispatch = EVHTTP_DISPATCH_ROUND_ROBIN;
+	http->seed = 2463534242U;
+	http->cpu = -1;
 
 	TAILQ_INIT(&http->sockets);
 	TAILQ_INIT(&http->callbacks);
 	TAILQ_INIT(&http->connections);
-	TAILQ_INIT(&http->tasks);
-
-	pthread_mutex_init(&http->lock, 0);
+	TAILQ_INIT(&http->pool.conns);
+	TAILQ_INIT(&http->pool.reqs);
 
 	return (http);
 }
@@ -2350,6 +3163,7 @@ evhttp_free(struct evhttp* http)
 {
 	struct evhttp_cb *http_cb;
 	struct evhttp_connection *evcon;
+	struct evhttp_request *req;
 	struct evhttp_bound_socket *bound;
 	int fd;
 
@@ -2363,12 +3177,26 @@ evhttp_free(struct evhttp* http)
 
 		free(bound);
 	}
+	event_del(&http->accept_pause);
+
+	/* nothing goes back into the pool from now on */
+	http->pool.max = 0;
 
 	while ((evcon = TAILQ_FIRST(&http->connections)) != NULL) {
 		/* evhttp_connection_free removes the connection */
 		evhttp_connection_free(evcon);
 	}
 
+	/* pooled objects are not owned by a server */
+	while ((evcon = TAILQ_FIRST(&http->pool.conns)) != NULL) {
+		TAILQ_REMOVE(&http->pool.conns, evcon, next);
+		evhttp_connection_free(evcon);
+	}
+	while ((req = TAILQ_FIRST(&http->pool.reqs)) != NULL) {
+		TAILQ_REMOVE(&http->pool.reqs, req, next);
+		evhttp_request_free(req);
+	}
+
 	while ((http_cb = TAILQ_FIRST(&http->callbacks)) != NULL) {
 		TAILQ_REMOVE(&http->callbacks, http_cb, next);
 		free(http_cb->what);
@@ -2386,6 +3214,15 @@ evhttp_free(struct evhttp* http)
 		evhttp_free(cur);
 	}
 
+	/* a worker: its notification and task ring */
+	if (http->wakeup) {
+		event_del(&http->notify);
+		if (http->rcv != http->wakeup)
+			close(http->rcv);
+		close(http->wakeup);
+	}
+	free(http->tasks.ring);
+
 	free(http);
 }
 
@@ -2405,6 +3242,42 @@ evhttp_set_timeout(struct evhttp* http, int timeout_in_secs)
 	}
 }
 
+void
+evhttp_set_pool(struct evhttp *http, int max, size_t buffer_max)
+{
+	http->pool.max = max;
+	http->pool.buffer_max = buffer_max;
+
+	/* set pool to workers */
+	if (http->cur) {
+		struct evhttp * cur = http->next;
+		do {
+			evhttp_set_pool(cur, max, buffer_max);
+			cur = cur->next;
+		} while (cur->next != http->next);
+		evhttp_set_pool(cur, max, buffer_max);
+	}
+}
+
+void
+evhttp_pool_stats(struct evhttp *http,
+    unsigned long *hits, unsigned long *misses)
+{
+	struct evhttp *worker = http->next;
+
+	*hits = __atomic_load_n(&http->pool.hits, __ATOMIC_RELAXED);
+	*misses = __atomic_load_n(&http->pool.misses, __ATOMIC_RELAXED);
+	if (worker == NULL)
+		return;
+	do {
+		*hits += __atomic_load_n(&worker->pool.hits,
+		    __ATOMIC_RELAXED);
+		*misses += __atomic_load_n(&worker->pool.misses,
+		    __ATOMIC_RELAXED);
+		worker = worker->next;
+	} while (worker != http->next);
+}
+
 void
 evhttp_set_cb(struct evhttp *http, const char *uri,
     void (*cb)(struct evhttp_request *, void *), void *cbarg)
@@ -2532,12 +3405,19 @@ evhttp_request_new(void (*cb)(struct evhttp_request *, void *), void *arg)
 void
 evhttp_request_free(struct evhttp_request *req)
 {
-	if (req->remote_host != NULL)
-		free(req->remote_host);
-	if (req->uri != NULL)
-		free(req->uri);
-	if (req->response_code_line != NULL)
-		free(req->response_code_line);
+	if ((req->flags & EVHTTP_REQ_POOLED) &&
+	    evhttp_pool_put_request(req->pool, req) == 0)
+		return;
+
+	/* strings of arena requests are freed with the arena */
+	if (!(req->flags & EVHTTP_REQ_ARENA)) {
+		if (req->remote_host != NULL)
+			free(req->remote_host);
+		if (req->uri != NULL)
+			free(req->uri);
+		if (req->response_code_line != NULL)
+			free(req->response_code_line);
+	}
 
 	evhttp_clear_headers(req->input_headers);
 	free(req->input_headers);
@@ -2572,6 +3452,140 @@ evhttp_request_uri(struct evhttp_request *req) {
 	return (req->uri);
 }
 
+/*
+ * Object pools of incoming connections.  A worker frees its connections
+ * and requests in its own thread, so the pools need no locking.
+ */
+
+static void
+evhttp_pool_count(unsigned long *counter)
+{
+	__atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+static struct evhttp_connection *
+evhttp_pool_get_connection(struct evhttp *http,
+    const char *address, unsigned short port)
+{
+	struct evhttp_pool *pool = &http->pool;
+	struct evhttp_connection *evcon = TAILQ_FIRST(&pool->conns);
+
+	if (evcon == NULL) {
+		evhttp_pool_count(&pool->misses);
+		return (evhttp_connection_new(address, port));
+	}
+	evhttp_pool_count(&pool->hits);
+	TAILQ_REMOVE(&pool->conns, evcon, next);
+	pool->nconns--;
+
+	/* the rest is zero from evhttp_pool_put_connection */
+	evcon->port = port;
+	evcon->timeout = -1;
+	if (strlen(address) < sizeof(evcon->host))
+		evcon->address = strcpy(evcon->host, address);
+	else if ((evcon->address = strdup(address)) == NULL) {
+		event_warn("%s: strdup failed", __func__);
+		evhttp_connection_free(evcon);
+		return (NULL);
+	}
+	evcon->state = EVCON_DISCONNECTED;
+	TAILQ_INIT(&evcon->requests);
+
+	return (evcon);
+}
+
+/* fails to compile if a member follows the arena of a connection */
+typedef char evhttp_arena_is_last[
+    offsetof(struct evhttp_connection, arena) +
+    sizeof(struct evhttp_arena) == sizeof(struct evhttp_connection) ? 1 : -1];
+
+/* keeps the connection and its buffers, returns -1 if the pool is full */
+static int
+evhttp_pool_put_connection(struct evhttp *http,
+    struct evhttp_connection *evcon)
+{
+	struct evhttp_pool *pool = &http->pool;
+	struct evbuffer *input = evcon->input_buffer;
+	struct evbuffer *output = evcon->output_buffer;
+	struct evbuffer *body = evcon->output_body;
+
+	if (pool->nconns >= pool->max)
+		return (-1);
+
+	evbuffer_reset(input, pool->buffer_max);
+	evbuffer_reset(output, pool->buffer_max);
+	evbuffer_reset(body, pool->buffer_max);
+	evhttp_arena_reset(&evcon->arena);
+
+	/* the arena is last and keeps its block */
+	memset(evcon, 0, offsetof(struct evhttp_connection, arena));
+	evcon->fd = -1;
+	evcon->input_buffer = input;
+	evcon->output_buffer = output;
+	evcon->output_body = body;
+
+	TAILQ_INSERT_HEAD(&pool->conns, evcon, next);
+	pool->nconns++;
+	return (0);
+}
+
+static struct evhttp_request *
+evhttp_pool_get_request(struct evhttp *http)
+{
+	struct evhttp_pool *pool = &http->pool;
+	struct evhttp_request *req = TAILQ_FIRST(&pool->reqs);
+
+	if (req == NULL) {
+		evhttp_pool_count(&pool->misses);
+		req = evhttp_request_new(evhttp_handle_request, http);
+		if (req == NULL)
+			return (NULL);
+	} else {
+		evhttp_pool_count(&pool->hits);
+		TAILQ_REMOVE(&pool->reqs, req, next);
+		pool->nreqs--;
+
+		req->kind = EVHTTP_RESPONSE;
+		req->cb = evhttp_handle_request;
+		req->cb_arg = http;
+	}
+
+	/* freed into this pool, whatever happens to its connection */
+	req->flags |= EVHTTP_REQ_POOLED;
+	req->pool = http;
+	return (req);
+}
+
+/* keeps the request and its buffers, returns -1 if the pool is full */
+static int
+evhttp_pool_put_request(struct evhttp *http, struct evhttp_request *req)
+{
+	struct evhttp_pool *pool = &http->pool;
+	struct evkeyvalq *input_headers = req->input_headers;
+	struct evkeyvalq *output_headers = req->output_headers;
+	struct evbuffer *input = req->input_buffer;
+	struct evbuffer *output = req->output_buffer;
+
+	if (pool->nreqs >= pool->max)
+		return (-1);
+
+	/* strings and headers are in the arena or freed here */
+	evhttp_clear_headers(input_headers);
+	evhttp_clear_headers(output_headers);
+	evbuffer_reset(input, pool->buffer_max);
+	evbuffer_reset(output, pool->buffer_max);
+
+	memset(req, 0, sizeof(*req));
+	req->input_headers = input_headers;
+	req->output_headers = output_headers;
+	req->input_buffer = input;
+	req->output_buffer = output;
+
+	TAILQ_INSERT_HEAD(&pool->reqs, req, next);
+	pool->nreqs++;
+	return (0);
+}
+
 /*
  * Takes a file descriptor to read a request from.
  * The callback is executed once the whole request has been read.
@@ -2583,22 +3597,16 @@ evhttp_get_request_connection(
 	int fd, struct sockaddr *sa, socklen_t salen)
 {
 	struct evhttp_connection *evcon;
-	char *hostname = NULL, *portname = NULL;
+	char hostname[NI_MAXHOST], portname[NI_MAXSERV];
 
-	name_from_addr(sa, salen, &hostname, &portname);
-	if (hostname == NULL || portname == NULL) {
-		if (hostname) free(hostname);
-		if (portname) free(portname);
+	if (name_from_addr(sa, salen, hostname, portname) == -1)
 		return (NULL);
-	}
 
 	event_debug(("%s: new request from %s:%s on %d\n",
 			__func__, hostname, portname, fd));
 
 	/* we need a connection object to put the http request on */
-	evcon = evhttp_connection_new(hostname, atoi(portname));
-	free(hostname);
-	free(portname);
+	evcon = evhttp_pool_get_connection(http, hostname, atoi(portname));
 	if (evcon == NULL)
 		return (NULL);
 
@@ -2618,18 +3626,21 @@ evhttp_associate_new_request_with_connection(struct evhttp_connection *evcon)
 {
 	struct evhttp *http = evcon->http_server;
 	struct evhttp_request *req;
-	if ((req = evhttp_request_new(evhttp_handle_request, http)) == NULL)
+	if ((req = evhttp_pool_get_request(http)) == NULL)
 		return (-1);
 
+	/* the previous request is freed, reuse its memory */
+	if (TAILQ_EMPTY(&evcon->requests))
+		evhttp_arena_reset(&evcon->arena);
+
 	req->evcon = evcon;	/* the request ends up owning the connection */
-	req->flags |= EVHTTP_REQ_OWN_CONNECTION;
+	req->flags |= EVHTTP_REQ_OWN_CONNECTION | EVHTTP_REQ_ARENA;
 	
 	TAILQ_INSERT_TAIL(&evcon->requests, req, next);
 	
 	req->kind = EVHTTP_REQUEST;
 	
-	if ((req->remote_host = strdup(evcon->address)) == NULL)
-		event_err(1, "%s: strdup", __func__);
+	req->remote_host = evcon->address;	/* lives as long as evcon */
 	req->remote_port = evcon->port;
 
 	evhttp_start_read(evcon);
@@ -2657,6 +3668,7 @@ evhttp_get_request(struct evhttp *http, int fd,
 	 */
 	evcon->http_server = http;
 	TAILQ_INSERT_TAIL(&http->connections, evcon, next);
+	__atomic_store_n(&http->nactive, http->nactive + 1, __ATOMIC_RELAXED);
 	
 	if (evhttp_associate_new_request_with_connection(evcon) == -1)
 		evhttp_connection_free(evcon);
@@ -2694,17 +3706,16 @@ addr_from_name(char *address)
 }
 #endif
 
-static void
+/* host must hold NI_MAXHOST bytes, port NI_MAXSERV */
+static int
 name_from_addr(struct sockaddr *sa, socklen_t salen,
-    char **phost, char **pport)
+    char *host, char *port)
 {
-	char ntop[NI_MAXHOST];
-	char strport[NI_MAXSERV];
 	int ni_result;
 
 #ifdef HAVE_GETNAMEINFO
 	ni_result = getnameinfo(sa, salen,
-		ntop, sizeof(ntop), strport, sizeof(strport),
+		host, NI_MAXHOST, port, NI_MAXSERV,
 		NI_NUMERICHOST|NI_NUMERICSERV);
 	
 	if (ni_result != 0) {
@@ -2712,17 +3723,16 @@ name_from_addr(struct sockaddr *sa, socklen_t salen,
 			event_err(1, "getnameinfo failed");
 		else
 			event_errx(1, "getnameinfo failed: %s", gai_strerror(ni_result));
-		return;
+		return (-1);
 	}
 #else
 	ni_result = fake_getnameinfo(sa, salen,
-		ntop, sizeof(ntop), strport, sizeof(strport),
+		host, NI_MAXHOST, port, NI_MAXSERV,
 		NI_NUMERICHOST|NI_NUMERICSERV);
 	if (ni_result != 0)
-			return;
+			return (-1);
 #endif
-	*phost = strdup(ntop);
-	*pport = strdup(strport);
+	return (0);
 }
 
 /* Create a non-blocking socket and bind it */
@@ -2751,10 +3761,18 @@ bind_socket_ai(struct addrinfo *ai, int reuse)
 #endif
 
         setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
-	if (reuse) {
+	if (reuse & BIND_REUSEADDR) {
 		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
 		    (void *)&on, sizeof(on));
 	}
+#ifdef SO_REUSEPORT
+	if ((reuse & BIND_REUSEPORT) &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+		(void *)&on, sizeof(on)) == -1) {
+		event_warn("setsockopt(SO_REUSEPORT)");
+		goto out;
+	}
+#endif
 
 	if (ai != NULL) {
 		r = bind(fd, ai->ai_addr, ai->ai_addrlen);
@@ -2875,6 +3893,52 @@ out:
 }
 
 
+void
+evhttp_set_dispatch(struct evhttp *http, int policy)
+{
+	http->dispatch = policy;
+}
+
+int
+evhttp_worker_set_cpu(struct evhttp *http, struct event_base *base, int cpu)
+{
+	struct evhttp *worker = http->next;
+
+	if (worker == NULL)
+		return (-1);
+	do {
+		if (worker->base == base) {
+			worker->cpu = cpu;
+			return (0);
+		}
+		worker = worker->next;
+	} while (worker != http->next);
+	return (-1);
+}
+
+int
+evhttp_worker_stats(struct evhttp *http, int *active, int *queued, int n)
+{
+	struct evhttp *worker = http->next;
+	int i = 0;
+
+	if (worker == NULL)
+		return (0);
+	do {
+		if (i < n) {
+			struct taskq *q = &worker->tasks;
+			active[i] = __atomic_load_n(&worker->nactive,
+			    __ATOMIC_RELAXED);
+			queued[i] = (int)(__atomic_load_n(&q->tail,
+			    __ATOMIC_RELAXED) - __atomic_load_n(&q->head,
+			    __ATOMIC_RELAXED));
+		}
+		i++;
+		worker = worker->next;
+	} while (worker != http->next);
+	return (i);
+}
+
 /* for multiple workers: */
 struct event_base *
 evhttp_add_worker(struct evhttp * http)
@@ -2889,7 +3953,16 @@ evhttp_add_worker(struct evhttp * http)
 	worker = evhttp_new(base);
 	if (!worker) goto fail;
 	
+	if (worker_tasks_init(&worker->tasks) != 0) goto fail;
+
+#ifdef HAVE_EVENTFD
+	fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fds[0] == -1) goto fail;
+#else
 	if (pipe(fds) != 0) goto fail;
+	evutil_make_socket_nonblocking(fds[0]);
+	evutil_make_socket_nonblocking(fds[1]);
+#endif
 
 	worker->wakeup = fds[1];
 	worker->rcv    = fds[0];
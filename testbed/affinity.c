@@ -0,0 +1,112 @@
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "affinity.h"
+
+/* CPUs allowed at start, before threads pin themselves */
+static cpu_set_t allowed;
+static int nallowed = -1;
+
+static void init_allowed()
+{
+	if (nallowed >= 0) {
+		return;
+	}
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		CPU_SET(0, &allowed);
+	}
+	nallowed = CPU_COUNT(&allowed);
+}
+
+int affinity_cpus()
+{
+	init_allowed();
+	return nallowed;
+}
+
+int affinity_cpu(int i)
+{
+	int cpu;
+
+	init_allowed();
+	i %= nallowed;
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, &allowed) && i-- == 0) {
+			return cpu;
+		}
+	}
+	return 0;
+}
+
+int affinity_pin(int cpu)
+{
+	cpu_set_t set;
+
+	init_allowed();
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int affinity_node(int cpu)
+{
+	char path[128];
+	int node;
+
+	for (node = 0; node < affinity_nodes(); ++node) {
+		snprintf(path, sizeof(path), 
+				"/sys/devices/system/node/node%d/cpu%d", node, cpu);
+		if (access(path, F_OK) == 0) {
+			return node;
+		}
+	}
+	return 0;
+}
+
+int affinity_nodes()
+{
+	static int nodes = 0;
+	char path[64];
+
+	if (nodes == 0) {
+		do {
+			snprintf(path, sizeof(path), 
+					"/sys/devices/system/node/node%d", nodes);
+		} while (access(path, F_OK) == 0 && ++nodes);
+		if (nodes == 0) {
+			nodes = 1;
+		}
+	}
+	return nodes;
+}
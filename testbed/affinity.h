@@ -0,0 +1,54 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CPUs and NUMA nodes of worker threads. Nodes are read from
+ * /sys/devices/system/node, without it every CPU is on node 0.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* affinity_cpus: number of CPUs the process may run on */
+int affinity_cpus();
+/* affinity_cpu: i-th allowed CPU, modulo their number */
+int affinity_cpu(int i);
+/* affinity_pin: run the calling thread on cpu only, 0 on success */
+int affinity_pin(int cpu);
+/* affinity_node: NUMA node of cpu */
+int affinity_node(int cpu);
+/* affinity_nodes: number of NUMA nodes */
+int affinity_nodes();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AFFINITY_H */
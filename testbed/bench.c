@@ -0,0 +1,357 @@
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+
+#include <event.h>
+#include <evhttp.h>
+#include <http-internal.h>
+
+#include "markov.h"
+#include "bench.h"
+#include "affinity.h"
+
+#define BENCH_LOOKUPS 4000000
+#define BENCH_PAGES   20000
+#define BENCH_PARSES  1000000
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* bench_lookup: time lookups of random present prefixes */
+void bench_lookup()
+{
+	int i;
+	uint32_t j;
+
+	for (i = 0; i < num_states; ++i) {
+		const MarkovModel * m = &markov_model[i];
+		uint32_t * keys = malloc(m->nstates * sizeof(uint32_t));
+		uint32_t nkeys = 0;
+		uint32_t check = 0;
+		unsigned int seed = i;
+		double t;
+
+		/* skip free places of chd table */
+		for (j = 0; j < m->nstates; ++j) {
+			if (m->states[j].nsuf) {
+				keys[nkeys++] = j;
+			}
+		}
+
+		t = now();
+		for (j = 0; j < BENCH_LOOKUPS; ++j) {
+			uint32_t k = keys[rand_r(&seed) % nkeys];
+			check += markov_lookup(m, &m->pref[k * m->order]) 
+				- &m->states[k];
+		}
+		t = now() - t;
+
+		fprintf(stderr, "model %d: order %u, %u states, hashing %u, "
+				"%.1lf ns/lookup%s\n", 
+				i, m->order, nkeys, m->hashing, t * 1e9 / BENCH_LOOKUPS,
+				check ? ", LOOKUP FAILED" : "");
+		free(keys);
+	}
+}
+
+/* time_pages: seconds to generate pages 1..n */
+static double time_pages(void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf), unsigned int n, 
+		uint64_t * bytes, uint32_t * check)
+{
+	struct evbuffer * buf = evbuffer_new();
+	unsigned int i;
+	size_t j;
+	double t;
+
+	t = 0;
+	*bytes = 0;
+	*check = 0;
+	for (i = 1; i <= n; ++i) {
+		double t0 = now();
+		page("localhost", i, buf);
+		t += now() - t0;
+		*bytes += EVBUFFER_LENGTH(buf);
+		/* output of a page must not change, print a checksum of it */
+		for (j = 0; j < EVBUFFER_LENGTH(buf); ++j) {
+			*check = *check * 31 + EVBUFFER_DATA(buf)[j];
+		}
+		evbuffer_drain(buf, EVBUFFER_LENGTH(buf));
+	}
+	evbuffer_free(buf);
+	return t;
+}
+
+void bench_pages(void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf))
+{
+	uint64_t bytes;
+	uint32_t check;
+	double t = time_pages(page, BENCH_PAGES, &bytes, &check);
+
+	fprintf(stderr, "pages: %d pages, %llu bytes, %.0lf pages/s, "
+			"%.1lf MB/s, checksum %08x\n", BENCH_PAGES, 
+			(unsigned long long)bytes, BENCH_PAGES / t, 
+			bytes / t / 1e6, check);
+}
+
+/* first allowed CPU of node, -1 if none */
+static int node_cpu(int node)
+{
+	int i;
+
+	for (i = 0; i < affinity_cpus(); ++i) {
+		if (affinity_node(affinity_cpu(i)) == node) {
+			return affinity_cpu(i);
+		}
+	}
+	return -1;
+}
+
+void bench_numa(void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf))
+{
+	int nodes = affinity_nodes();
+	int mem, run;
+
+	if (nodes == 1) {
+		fprintf(stderr, "numa: 1 node, all model reads are local\n");
+	}
+	for (mem = 0; mem < nodes; ++mem) {
+		MarkovModel * replica;
+
+		if (node_cpu(mem) < 0) {
+			continue;
+		}
+		affinity_pin(node_cpu(mem));
+		replica = markov_replicate();
+
+		for (run = 0; run < nodes; ++run) {
+			uint64_t bytes;
+			uint32_t check;
+			double t;
+
+			if (node_cpu(run) < 0) {
+				continue;
+			}
+			affinity_pin(node_cpu(run));
+			markov_use(replica);
+			t = time_pages(page, BENCH_PAGES, &bytes, &check);
+			markov_use(0);
+			fprintf(stderr, "numa: thread on node %d, model on node %d: "
+					"%.0lf pages/s, %.1lf MB/s, checksum %08x%s\n", 
+					run, mem, BENCH_PAGES / t, bytes / t / 1e6, check,
+					run == mem ? "" : " (remote)");
+		}
+		/* replicas are not freed, the benchmark exits */
+	}
+}
+
+/* request heads of crawlers, replayed by bench_parse without a file */
+static const char * crawler_heads[] = {
+	"GET /robots.txt HTTP/1.1\r\n"
+	"Host: serv0.testbed.local\r\n"
+	"Connection: keep-alive\r\n"
+	"User-Agent: Mozilla/5.0 (compatible; Googlebot/2.1; "
+		"+http://www.google.com/bot.html)\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+		"*/*;q=0.8\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"From: googlebot(at)googlebot.com\r\n"
+	"\r\n",
+
+	"GET /1185020.html HTTP/1.1\r\n"
+	"Host: serv0.testbed.local\r\n"
+	"Accept: */*\r\n"
+	"User-Agent: Mozilla/5.0 (compatible; bingbot/2.0; "
+		"+http://www.bing.com/bingbot.htm)\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Pragma: no-cache\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: Keep-Alive\r\n"
+	"\r\n",
+
+	"GET /6259480.html HTTP/1.1\r\n"
+	"Host: serv1.testbed.local\r\n"
+	"Connection: keep-alive\r\n"
+	"Accept: */*\r\n"
+	"Accept-Encoding: gzip,deflate\r\n"
+	"Accept-Language: ru, uk;q=0.8, be;q=0.8, en;q=0.7, *;q=0.01\r\n"
+	"User-Agent: Mozilla/5.0 (compatible; YandexBot/3.0; "
+		"+http://yandex.com/bots)\r\n"
+	"If-Modified-Since: Sat, 17 Oct 2026 10:21:44 GMT\r\n"
+	"\r\n",
+
+	"GET /6836659.html HTTP/1.1\r\n"
+	"Host: serv0.testbed.local\r\n"
+	"Connection: close\r\n"
+	"User-Agent: Mozilla/5.0 (compatible; Baiduspider/2.0; "
+		"+http://www.baidu.com/search/spider.html)\r\n"
+	"Accept-Encoding: gzip\r\n"
+	"Accept-Language: zh-cn,zh-tw\r\n"
+	"Accept: */*\r\n"
+	"\r\n",
+
+	"GET /4245439.html HTTP/1.0\r\n"
+	"Host: serv1.testbed.local\r\n"
+	"User-Agent: Wget/1.21.4\r\n"
+	"Accept: */*\r\n"
+	"\r\n",
+
+	"GET http://serv0.testbed.local/1566269.html HTTP/1.1\r\n"
+	"Host: serv0.testbed.local\r\n"
+	"User-Agent: Mozilla/5.0 (compatible; MJ12bot/v1.4.8; "
+		"http://mj12bot.com/)\r\n"
+	"Accept: text/html,text/plain,text/xml,text/*,application/xml,"
+		"application/xhtml+xml,application/rss+xml,\r\n"
+	"\tapplication/atom+xml,application/rdf+xml\r\n"
+	"Accept-Language: en\r\n"
+	"Proxy-Connection: keep-alive\r\n"
+	"\r\n",
+};
+
+/* load_heads: heads of file separated by empty lines, lines end in CRLF */
+static const char ** load_heads(const char * file, int * n)
+{
+	const char ** heads = 0;
+	FILE * f = fopen(file, "rb");
+	char line[16384];
+	char * head = 0;
+	size_t len = 0;
+
+	*n = 0;
+	if (!f) {
+		fprintf(stderr, "cannot open %s\n", file);
+		exit(1);
+	}
+	while (1) {
+		char * eol = fgets(line, sizeof(line), f);
+		size_t l = eol ? strcspn(line, "\r\n") : 0;
+
+		if (l > 0) {
+			head = realloc(head, len + l + 3);
+			memcpy(head + len, line, l);
+			len += l;
+			memcpy(head + len, "\r\n", 3);
+			len += 2;
+		} else if (head) {
+			head = realloc(head, len + 3);
+			memcpy(head + len, "\r\n", 3);
+			heads = realloc(heads, (*n + 1) * sizeof(char *));
+			heads[(*n)++] = head;
+			head = 0;
+			len = 0;
+		}
+		if (!eol) {
+			break;
+		}
+	}
+	fclose(f);
+	if (!*n) {
+		fprintf(stderr, "no request heads in %s\n", file);
+		exit(1);
+	}
+	return heads;
+}
+
+/* bench_parse: time parsing of request heads by libevent, as a
+ * connection of the server parses them in its input buffer */
+void bench_parse(const char * file)
+{
+	struct evhttp_connection * evcon = evhttp_connection_new("127.0.0.1", 0);
+	struct evhttp_request * req = evhttp_request_new(NULL, NULL);
+	struct evbuffer * buf = evbuffer_new();
+	const char ** heads = crawler_heads;
+	int nheads = sizeof(crawler_heads) / sizeof(crawler_heads[0]);
+	size_t * lens;
+	uint64_t bytes = 0;
+	uint32_t check = 0;
+	int failed = 0;
+	double t;
+	int i;
+
+	if (file) {
+		heads = load_heads(file, &nheads);
+	}
+	lens = malloc(nheads * sizeof(size_t));
+	for (i = 0; i < nheads; ++i) {
+		lens[i] = strlen(heads[i]);
+	}
+
+	/* strings of the request go to the arena of evcon, as in the server */
+	req->evcon = evcon;
+	req->kind = EVHTTP_REQUEST;
+	req->flags |= EVHTTP_REQ_ARENA;
+
+	t = now();
+	for (i = 0; i < BENCH_PARSES; ++i) {
+		int k = i % nheads;
+		const char * host;
+
+		bytes += lens[k];
+		evbuffer_add(buf, heads[k], lens[k]);
+		if (evhttp_parse_firstline(req, buf) != ALL_DATA_READ ||
+			evhttp_parse_headers(req, buf) != ALL_DATA_READ)
+		{
+			failed++;
+			evbuffer_drain(buf, EVBUFFER_LENGTH(buf));
+		} else {
+			/* the server looks up the host of every request */
+			host = evhttp_find_header(req->input_headers, "Host");
+			check = check * 31 + strlen(req->uri);
+			check = check * 31 + (host ? strlen(host) : 0);
+		}
+		evhttp_clear_headers(req->input_headers);
+		req->uri = NULL;
+		req->flags &= ~EVHTTP_PROXY_REQUEST;
+		evhttp_arena_reset(&evcon->arena);
+	}
+	t = now() - t;
+
+	fprintf(stderr, "parse: %d heads, %.1lf bytes/head, %.0lf ns/head, "
+			"%.1lf MB/s, checksum %08x%s\n", nheads,
+			(double)bytes / BENCH_PARSES, t * 1e9 / BENCH_PARSES,
+			bytes / t / 1e6, check, failed ? ", PARSE FAILED" : "");
+
+	req->evcon = NULL;
+	evhttp_request_free(req);
+	evhttp_connection_free(evcon);
+	evbuffer_free(buf);
+	free(lens);
+	/* heads of the file are not freed, the benchmark exits */
+}
@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct evbuffer;
+
+/* benchmarks of loaded models, results go to stderr */
+void bench_lookup();
+/* bench_pages: time generation of pages 1..N with page(host, id, buf) */
+void bench_pages(void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf));
+/* bench_numa: bench_pages of every node with models of every node */
+void bench_numa(void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf));
+/* bench_parse: time parsing of request heads of file, separated by
+ * empty lines, or of built-in heads of crawlers if file is 0 */
+void bench_parse(const char * file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_H */
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <event.h>
+
+#include "cache.h"
+
+typedef struct CacheEntry CacheEntry;
+typedef struct CacheShard CacheShard;
+
+struct CacheEntry {
+	uint64_t key;
+	CacheEntry * next;     /* hash chain */
+	uint32_t slot;         /* position in the clock */
+	uint32_t ref;          /* used since the hand passed */
+	int refs;              /* the cache and buffers sending the page */
+	size_t len;
+	char data[1];
+};
+
+struct CacheShard {
+	pthread_mutex_t lock;
+	CacheEntry ** bucket;  /* hash chains */
+	uint32_t nbucket;      /* power of 2 */
+	CacheEntry ** clock;   /* pages in clock order, holes are 0 */
+	uint32_t nclock;
+	uint32_t maxclock;
+	uint32_t * holes;      /* free places of clock */
+	uint32_t nfree;
+	uint32_t hand;
+	uint32_t npages;
+	size_t used;           /* bytes */
+	size_t max_bytes;
+	uint64_t hits;
+	uint64_t misses;
+	char pad[64];          /* shards are written by different threads */
+};
+
+struct PageCache {
+	CacheShard * shards;
+	int nshards;
+};
+
+#define ENTRY_SIZE(len) (sizeof(CacheEntry) + (len))
+
+PageCache * cache_new(size_t max_bytes, int nshards)
+{
+	PageCache * c = calloc(1, sizeof(PageCache));
+	int i;
+
+	if (nshards <= 0) nshards = 1;
+	c->nshards = nshards;
+	c->shards  = calloc(nshards, sizeof(CacheShard));
+	for (i = 0; i < nshards; ++i) {
+		CacheShard * s = &c->shards[i];
+		pthread_mutex_init(&s->lock, 0);
+		s->nbucket   = 1024;
+		s->bucket    = calloc(s->nbucket, sizeof(CacheEntry*));
+		s->max_bytes = max_bytes / nshards;
+	}
+	return c;
+}
+
+static inline CacheShard * shard(PageCache * c, uint64_t key)
+{
+	return &c->shards[(key >> 32) % c->nshards];
+}
+
+static CacheEntry ** find(CacheShard * s, uint64_t key)
+{
+	CacheEntry ** e = &s->bucket[key & (s->nbucket - 1)];
+	while (*e && (*e)->key != key) {
+		e = &(*e)->next;
+	}
+	return e;
+}
+
+/* release: a buffer has sent the page, or the cache evicted it */
+static void release(void * arg)
+{
+	CacheEntry * e = arg;
+	if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		free(e);
+	}
+}
+
+int cache_get(PageCache * c, uint64_t key, struct evbuffer * buf)
+{
+	CacheShard * s = shard(c, key);
+	CacheEntry * e;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->lock);
+	e = *find(s, key);
+	if (e) {
+		e->ref = 1;
+		s->hits += 1;
+		/* the page is referenced, not copied, it lives until sent */
+		__atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+		ret = evbuffer_add_reference(buf, e->data, e->len, release, e) == 0;
+		if (!ret) {
+			release(e);
+		}
+	} else {
+		s->misses += 1;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return ret;
+}
+
+/* evict: advance the hand to a page not used since the last pass */
+static void evict(CacheShard * s)
+{
+	CacheEntry * e;
+
+	for (;;) {
+		if (s->hand >= s->nclock) {
+			s->hand = 0;
+		}
+		e = s->clock[s->hand++];
+		if (!e) {
+			continue;
+		}
+		if (e->ref) {
+			e->ref = 0;
+			continue;
+		}
+		break;
+	}
+
+	*find(s, e->key) = e->next;
+	s->clock[e->slot] = 0;
+	s->holes[s->nfree++] = e->slot;
+	s->used   -= ENTRY_SIZE(e->len);
+	s->npages -= 1;
+	release(e);
+}
+
+static void grow_buckets(CacheShard * s)
+{
+	CacheEntry ** old = s->bucket;
+	uint32_t n = s->nbucket;
+	uint32_t i;
+
+	s->nbucket *= 2;
+	s->bucket   = calloc(s->nbucket, sizeof(CacheEntry*));
+	for (i = 0; i < n; ++i) {
+		CacheEntry * e = old[i];
+		while (e) {
+			CacheEntry * next = e->next;
+			CacheEntry ** b = &s->bucket[e->key & (s->nbucket - 1)];
+			e->next = *b;
+			*b = e;
+			e = next;
+		}
+	}
+	free(old);
+}
+
+void cache_put(PageCache * c, uint64_t key, struct evbuffer * page)
+{
+	CacheShard * s = shard(c, key);
+	CacheEntry ** b;
+	CacheEntry * e;
+	size_t len = EVBUFFER_LENGTH(page);
+
+	if (ENTRY_SIZE(len) > s->max_bytes) {
+		return;
+	}
+
+	/* copy outside of the lock */
+	e = malloc(ENTRY_SIZE(len));
+	if (!e) {
+		return;
+	}
+	e->key = key;
+	e->ref = 0;
+	e->refs = 1;
+	e->len = len;
+	/* segments of a generated page are not joined */
+	evbuffer_copyout(page, e->data, len);
+
+	pthread_mutex_lock(&s->lock);
+	b = find(s, key);
+	if (*b) {
+		/* put by other thread */
+		pthread_mutex_unlock(&s->lock);
+		free(e);
+		return;
+	}
+
+	while (s->used + ENTRY_SIZE(len) > s->max_bytes) {
+		evict(s);
+	}
+
+	if (s->nfree > 0) {
+		e->slot = s->holes[--s->nfree];
+	} else {
+		if (s->nclock == s->maxclock) {
+			s->maxclock = s->maxclock ? 2 * s->maxclock : 1024;
+			s->clock = realloc(s->clock, s->maxclock * sizeof(CacheEntry*));
+			s->holes = realloc(s->holes, s->maxclock * sizeof(uint32_t));
+		}
+		e->slot = s->nclock++;
+	}
+	s->clock[e->slot] = e;
+	b = find(s, key);
+	e->next = *b;
+	*b = e;
+	s->used   += ENTRY_SIZE(len);
+	s->npages += 1;
+	if (s->npages > s->nbucket) {
+		grow_buckets(s);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+void cache_stats(PageCache * c, uint64_t * hits, uint64_t * misses, 
+		uint64_t * pages, uint64_t * bytes)
+{
+	int i;
+
+	*hits = *misses = *pages = *bytes = 0;
+	for (i = 0; i < c->nshards; ++i) {
+		CacheShard * s = &c->shards[i];
+		pthread_mutex_lock(&s->lock);
+		*hits   += s->hits;
+		*misses += s->misses;
+		*pages  += s->npages;
+		*bytes  += s->used;
+		pthread_mutex_unlock(&s->lock);
+	}
+}
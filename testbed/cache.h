@@ -0,0 +1,63 @@
+#ifndef CACHE_H
+#define CACHE_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Cache of rendered pages shared by worker threads. Pages are keyed by
+ * the 64-bit key of their random stream, so a key is a (host, page id)
+ * pair. The cache is split into shards with their own lock, every
+ * shard keeps at most its part of the memory limit and evicts pages
+ * with the CLOCK algorithm.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct evbuffer;
+
+typedef struct PageCache PageCache;
+
+PageCache * cache_new(size_t max_bytes, int nshards);
+/* cache_get: append page of key to buf without copying it, 0 if it is 
+   not cached; an evicted page is freed when buf releases it */
+int cache_get(PageCache * c, uint64_t key, struct evbuffer * buf);
+/* cache_put: store a copy of page of key, unless over the shard limit */
+void cache_put(PageCache * c, uint64_t key, struct evbuffer * page);
+/* cache_stats: counters summed over shards */
+void cache_stats(PageCache * c, uint64_t * hits, uint64_t * misses, 
+		uint64_t * pages, uint64_t * bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CACHE_H */
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <event.h>
+
+#include "corpus.h"
+
+#define CORPUS_MAGIC      "MARKOVP"
+#define CORPUS_VERSION    1
+#define CORPUS_BYTE_ORDER 0x01020304
+#define CORPUS_CHUNK      256    /* pages a thread generates at a time */
+
+typedef struct CorpusHeader CorpusHeader;
+typedef struct CorpusPage CorpusPage;
+
+struct CorpusHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t npages;
+	uint32_t pad;
+	uint64_t index;        /* offset of npages CorpusPage */
+};
+
+struct CorpusPage {
+	uint64_t off;
+	uint64_t len;
+};
+
+struct Corpus {
+	const char * base;
+	uint64_t size;
+	const CorpusPage * index;
+	uint32_t npages;
+};
+
+typedef struct CorpusWriter CorpusWriter;
+struct CorpusWriter {
+	pthread_mutex_t lock;
+	int fd;
+	const char * file;
+	uint32_t npages;
+	uint32_t next;         /* first page of the next chunk */
+	uint64_t end;          /* end of file */
+	CorpusPage * index;
+	void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf);
+};
+
+static void * write_thr(void * arg)
+{
+	CorpusWriter * w = arg;
+	struct evbuffer * buf = evbuffer_new();
+	CorpusPage * chunk = malloc(CORPUS_CHUNK * sizeof(CorpusPage));
+	uint32_t first, last, id;
+	uint64_t off, done;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		first   = w->next;
+		last    = w->npages - first < CORPUS_CHUNK 
+			? w->npages : first + CORPUS_CHUNK;
+		w->next = last;
+		pthread_mutex_unlock(&w->lock);
+		if (first == last) {
+			break;
+		}
+
+		for (id = first; id < last; ++id) {
+			size_t before = EVBUFFER_LENGTH(buf);
+			w->page("", id, buf);
+			chunk[id - first].off = before;
+			chunk[id - first].len = EVBUFFER_LENGTH(buf) - before;
+		}
+
+		/* chunks are written in the order they are done */
+		pthread_mutex_lock(&w->lock);
+		off     = w->end;
+		w->end += EVBUFFER_LENGTH(buf);
+		pthread_mutex_unlock(&w->lock);
+
+		for (done = 0; done < EVBUFFER_LENGTH(buf); ) {
+			ssize_t n = pwrite(w->fd, EVBUFFER_DATA(buf) + done, 
+					EVBUFFER_LENGTH(buf) - done, off + done);
+			if (n <= 0) {
+				fprintf(stderr, "cannot write %s\n", w->file);
+				exit(1);
+			}
+			done += n;
+		}
+		for (id = first; id < last; ++id) {
+			w->index[id].off = off + chunk[id - first].off;
+			w->index[id].len = chunk[id - first].len;
+		}
+		evbuffer_drain(buf, EVBUFFER_LENGTH(buf));
+	}
+
+	free(chunk);
+	evbuffer_free(buf);
+	return 0;
+}
+
+void corpus_write(const char * file, uint32_t npages, int nthreads,
+		void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf))
+{
+	CorpusWriter w;
+	CorpusHeader h;
+	pthread_t * threads;
+	uint64_t size;
+	int i;
+
+	memset(&w, 0, sizeof(w));
+	w.fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w.fd < 0) {
+		fprintf(stderr, "cannot write %s\n", file);
+		exit(1);
+	}
+	pthread_mutex_init(&w.lock, 0);
+	w.file   = file;
+	w.npages = npages;
+	w.end    = sizeof(CorpusHeader);
+	w.page   = page;
+	w.index  = malloc((npages ? npages : 1) * sizeof(CorpusPage));
+
+	if (nthreads <= 0) nthreads = 1;
+	fprintf(stderr, "generating %u pages with %d threads\n", 
+			npages, nthreads);
+
+	threads = malloc(nthreads * sizeof(pthread_t));
+	for (i = 0; i < nthreads; ++i) {
+		if (pthread_create(&threads[i], 0, write_thr, &w) != 0) {
+			fprintf(stderr, "cannot create thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; ++i) {
+		pthread_join(threads[i], 0);
+	}
+	free(threads);
+	pthread_mutex_destroy(&w.lock);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CORPUS_MAGIC, sizeof(h.magic));
+	h.version    = CORPUS_VERSION;
+	h.byte_order = CORPUS_BYTE_ORDER;
+	h.npages     = npages;
+	h.index      = (w.end + 7) & ~(uint64_t)7;
+	size         = (uint64_t)npages * sizeof(CorpusPage);
+
+	if (pwrite(w.fd, w.index, size, h.index) != (ssize_t)size
+			|| pwrite(w.fd, &h, sizeof(h), 0) != sizeof(h)
+			|| close(w.fd) != 0)
+	{
+		fprintf(stderr, "cannot write %s\n", file);
+		exit(1);
+	}
+	free(w.index);
+
+	fprintf(stderr, "%u pages, %llu bytes saved to %s\n", npages, 
+			(unsigned long long)(w.end - sizeof(h)), file);
+}
+
+static void corrupted(const char * file)
+{
+	fprintf(stderr, "%s is corrupted\n", file);
+	exit(1);
+}
+
+Corpus * corpus_open(const char * file)
+{
+	Corpus * c;
+	const CorpusHeader * h;
+	struct stat st;
+	uint32_t i;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "cannot read %s\n", file);
+		exit(1);
+	}
+	if ((uint64_t)st.st_size < sizeof(CorpusHeader)) {
+		corrupted(file);
+	}
+
+	c = calloc(1, sizeof(Corpus));
+	c->size = st.st_size;
+	c->base = mmap(0, c->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (c->base == MAP_FAILED) {
+		fprintf(stderr, "cannot mmap %s\n", file);
+		exit(1);
+	}
+	close(fd);
+
+	h = (const CorpusHeader *)c->base;
+	if (memcmp(h->magic, CORPUS_MAGIC, sizeof(h->magic)) != 0
+			|| h->version != CORPUS_VERSION
+			|| h->byte_order != CORPUS_BYTE_ORDER)
+	{
+		fprintf(stderr, "%s: unsupported corpus file\n", file);
+		exit(1);
+	}
+	if (h->npages == 0 || h->index > c->size || (h->index & 7) != 0
+			|| (uint64_t)h->npages * sizeof(CorpusPage) > c->size - h->index)
+	{
+		corrupted(file);
+	}
+	c->npages = h->npages;
+	c->index  = (const CorpusPage *)(c->base + h->index);
+	for (i = 0; i < c->npages; ++i) {
+		if (c->index[i].off > h->index 
+				|| c->index[i].len > h->index - c->index[i].off)
+		{
+			corrupted(file);
+		}
+	}
+
+	/* pages are read in random order */
+	madvise((void*)c->base, c->size, MADV_RANDOM);
+
+	fprintf(stderr, "%s mapped: %u pages\n", file, c->npages);
+	return c;
+}
+
+uint32_t corpus_pages(const Corpus * c)
+{
+	return c->npages;
+}
+
+void corpus_page(const Corpus * c, uint32_t id, 
+		const char ** data, size_t * len)
+{
+	*data = c->base + c->index[id].off;
+	*len  = c->index[id].len;
+}
@@ -0,0 +1,63 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Corpus file: pages 0..N-1 generated offline, packed one after another
+ * with an index of offsets. The server maps the file and serves pages
+ * from it without generating text.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct evbuffer;
+
+typedef struct Corpus Corpus;
+
+/* corpus_write: generate pages 0..npages-1 with page(host, id, buf) 
+   in nthreads threads into file */
+void corpus_write(const char * file, uint32_t npages, int nthreads,
+		void (*page)(const char * host, unsigned int id, 
+			struct evbuffer * buf));
+/* corpus_open: map file, exit on error */
+Corpus * corpus_open(const char * file);
+uint32_t corpus_pages(const Corpus * c);
+/* corpus_page: page id, id < corpus_pages() */
+void corpus_page(const Corpus * c, uint32_t id, 
+		const char ** data, size_t * len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CORPUS_H */
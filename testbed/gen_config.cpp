@@ -30,6 +30,9 @@
 #include <stdio.h>
 #include "my_config.h"
 #include "gen_config.h"
+#include "markov.h"
+#include "prng.h"
+#include <evhttp.h>
 
 static void
 load_defaults(struct GenConfig * conf)
@@ -38,9 +41,30 @@ load_defaults(struct GenConfig * conf)
 	conf->words_per_page = 1000;
 	conf->links_total    = 100000;
 	conf->worker_threads = 1;
+	conf->reuseport      = 1;
+	conf->dispatch       = EVHTTP_DISPATCH_ROUND_ROBIN;
+	conf->pin_workers    = 0;
+	conf->numa_replicas  = 0;
+	conf->pool_size      = 256;
+	conf->pool_buffer    = 16;
 	conf->extern_links_prefix  = strdup("serv");
 	conf->extern_links_suffix  = strdup(".testbed.local");
 	conf->extern_links_servers = 1;
+	conf->model_file = 0;
+	conf->corpus_file = 0;
+	conf->bench_requests = 0;
+	conf->hashing    = MARKOV_HASH_CHD;
+	conf->loader_threads = 0;
+	conf->cache_size     = 0;
+	conf->cache_shards   = 16;
+	conf->stream_words   = 0;
+	conf->nweights       = 0;
+	conf->weight_prefix  = 0;
+	conf->weight         = 0;
+	conf->order          = NPREF;
+	conf->norders        = 0;
+	conf->order_prefix   = 0;
+	conf->orders         = 0;
 }
 
 static void
@@ -48,8 +72,8 @@ print_config(struct GenConfig * conf)
 {
 	fprintf(stderr, "daemon_port %d\n",     conf->daemon_port);
 	fprintf(stderr, "words_per_page %d\n",  conf->words_per_page);
-	fprintf(stderr, "intern links %d\n",    conf->intern_links);
-	fprintf(stderr, "extern links %d\n",    conf->extern_links);
+	fprintf(stderr, "intern links %u\n",    conf->intern_links);
+	fprintf(stderr, "extern links %u\n",    conf->extern_links);
 	fprintf(stderr, "intern probabil %lf\n",conf->intern_links_probability);
 	fprintf(stderr, "extern probabil %lf\n",conf->extern_links_probability);
 	fprintf(stderr, "extern links prefix %s\n",
@@ -60,11 +84,37 @@ print_config(struct GenConfig * conf)
 			conf->extern_links_servers);
 	fprintf(stderr, "links_total %d\n",     conf->links_total);
 	fprintf(stderr, "worker_threads %d\n",  conf->worker_threads);
+	fprintf(stderr, "reuseport %d\n",       conf->reuseport);
+	fprintf(stderr, "dispatch %d\n",        conf->dispatch);
+	fprintf(stderr, "pin_workers %d\n",     conf->pin_workers);
+	fprintf(stderr, "numa_replicas %d\n",   conf->numa_replicas);
+	fprintf(stderr, "pool_size %d\n",       conf->pool_size);
+	fprintf(stderr, "pool_buffer %d\n",     conf->pool_buffer);
+	fprintf(stderr, "model_file %s\n",
+			conf->model_file ? conf->model_file : "none");
+	fprintf(stderr, "corpus_file %s\n",
+			conf->corpus_file ? conf->corpus_file : "none");
+	fprintf(stderr, "bench_requests %s\n",
+			conf->bench_requests ? conf->bench_requests : "none");
+	fprintf(stderr, "hashing %d\n",         conf->hashing);
+	fprintf(stderr, "loader_threads %d\n",  conf->loader_threads);
+	fprintf(stderr, "cache_size %d\n",      conf->cache_size);
+	fprintf(stderr, "cache_shards %d\n",    conf->cache_shards);
+	fprintf(stderr, "stream_words %d\n",    conf->stream_words);
+	for (int i = 0; i < conf->nweights; ++i) {
+		fprintf(stderr, "weight %s %d\n",
+				conf->weight_prefix[i], conf->weight[i]);
+	}
+	fprintf(stderr, "order %d\n",           conf->order);
+	for (int i = 0; i < conf->norders; ++i) {
+		fprintf(stderr, "order %s %d\n",
+				conf->order_prefix[i], conf->orders[i]);
+	}
 }
 
 void load_config(struct GenConfig * conf, const char * config_name)
 {
-	std::string tmp1, tmp2;
+	std::string tmp1, tmp2, tmp3, tmp4, tmp5, tmp6;
 	load_defaults(conf);
 	config_data_t c = config_load(config_name);
 	config_try_set_int(c, "generator", "daemon_port",       conf->daemon_port);
@@ -75,12 +125,85 @@ void load_config(struct GenConfig * conf, const char * config_name)
 			conf->intern_links_probability);
 	config_try_set_int(c, "generator", "links_total",       conf->links_total);
 	config_try_set_int(c, "generator", "worker_threads",    conf->worker_threads);
+	config_try_set_int(c, "generator", "reuseport",         conf->reuseport);
+	config_try_set_int(c, "generator", "pin_workers",       conf->pin_workers);
+	config_try_set_int(c, "generator", "numa_replicas",     conf->numa_replicas);
+	config_try_set_int(c, "generator", "pool_size",         conf->pool_size);
+	config_try_set_int(c, "generator", "pool_buffer",       conf->pool_buffer);
+	config_try_set_int(c, "generator", "loader_threads",    conf->loader_threads);
+	config_try_set_int(c, "generator", "order",             conf->order);
+	config_try_set_int(c, "generator", "cache_size",        conf->cache_size);
+	config_try_set_int(c, "generator", "cache_shards",      conf->cache_shards);
+	config_try_set_int(c, "generator", "stream_words",      conf->stream_words);
 
 	config_try_set_str(c, "generator", "extern_links_prefix", tmp1);
 	config_try_set_str(c, "generator", "extern_links_suffix", tmp2);
 	config_try_set_int(c, "generator", "extern_links_servers", 
 			conf->extern_links_servers);
 
+	config_try_set_str(c, "generator", "model_file", tmp3);
+	if (!tmp3.empty()) {
+		conf->model_file = strdup(tmp3.c_str());
+	}
+
+	config_try_set_str(c, "generator", "corpus_file", tmp5);
+	if (!tmp5.empty()) {
+		conf->corpus_file = strdup(tmp5.c_str());
+	}
+
+	config_try_set_str(c, "generator", "bench_requests", tmp6);
+	if (!tmp6.empty()) {
+		conf->bench_requests = strdup(tmp6.c_str());
+	}
+
+	config_try_set_str(c, "generator", "hashing", tmp4);
+	if (tmp4 == "chain") {
+		conf->hashing = MARKOV_HASH_CHAIN;
+	} else if (tmp4 == "ideal") {
+		conf->hashing = MARKOV_HASH_IDEAL;
+	} else if (tmp4 == "chd") {
+		conf->hashing = MARKOV_HASH_CHD;
+	} else if (!tmp4.empty()) {
+		fprintf(stderr, "unknown hashing %s\n", tmp4.c_str());
+	}
+
+	config_try_set_str(c, "generator", "dispatch", tmp5);
+	if (tmp5 == "round_robin") {
+		conf->dispatch = EVHTTP_DISPATCH_ROUND_ROBIN;
+	} else if (tmp5 == "least_conn") {
+		conf->dispatch = EVHTTP_DISPATCH_LEAST_CONN;
+	} else if (tmp5 == "two_choices") {
+		conf->dispatch = EVHTTP_DISPATCH_TWO_CHOICES;
+	} else if (tmp5 == "cpu") {
+		conf->dispatch = EVHTTP_DISPATCH_CPU;
+	} else if (!tmp5.empty()) {
+		fprintf(stderr, "unknown dispatch %s\n", tmp5.c_str());
+	}
+
+	config_section_t & weights = c["weights"];
+	conf->nweights      = (int)weights.size();
+	conf->weight_prefix = (char**)malloc(weights.size() * sizeof(char*));
+	conf->weight        = (int*)malloc(weights.size() * sizeof(int));
+	int i = 0;
+	for (config_section_t::iterator it = weights.begin(); 
+			it != weights.end(); ++it, ++i)
+	{
+		conf->weight_prefix[i] = strdup(it->first.c_str());
+		conf->weight[i]        = atoi(it->second.c_str());
+	}
+
+	config_section_t & orders = c["order"];
+	conf->norders      = (int)orders.size();
+	conf->order_prefix = (char**)malloc(orders.size() * sizeof(char*));
+	conf->orders       = (int*)malloc(orders.size() * sizeof(int));
+	i = 0;
+	for (config_section_t::iterator it = orders.begin(); 
+			it != orders.end(); ++it, ++i)
+	{
+		conf->order_prefix[i] = strdup(it->first.c_str());
+		conf->orders[i]       = atoi(it->second.c_str());
+	}
+
 	if (!tmp1.empty() && tmp2.empty()) {
 		conf->extern_links_prefix = strdup(tmp1.c_str());
 		conf->extern_links_suffix = strdup(tmp2.c_str());
@@ -98,10 +221,16 @@ void load_config(struct GenConfig * conf, const char * config_name)
 		conf->intern_links_probability = 0.01;
 	}
 
-	conf->intern_links = (int)((double)RAND_MAX 
-			* conf->intern_links_probability);
-	conf->extern_links = (int)((double)RAND_MAX
-			* conf->extern_links_probability);
+	if (conf->cache_shards <= 0) {
+		conf->cache_shards = 1;
+	}
+
+	if (conf->loader_threads <= 0) {
+		conf->loader_threads = conf->worker_threads;
+	}
+
+	conf->intern_links = prng_prob(conf->intern_links_probability);
+	conf->extern_links = prng_prob(conf->extern_links_probability);
 	print_config(conf);
 }
 
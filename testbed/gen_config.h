@@ -34,8 +34,8 @@ extern "C" {
 struct GenConfig {
 	int daemon_port;
 	int words_per_page;
-	int intern_links;
-	int extern_links;
+	uint32_t intern_links;  /* 32-bit random threshold of a link */
+	uint32_t extern_links;
 	double intern_links_probability;
 	double extern_links_probability;
 	char * extern_links_prefix;
@@ -43,6 +43,29 @@ struct GenConfig {
 	int extern_links_servers;
 	int links_total;
 	int worker_threads;
+	int reuseport;          /* a SO_REUSEPORT socket per worker */
+	int dispatch;           /* EVHTTP_DISPATCH_* without reuseport */
+	int pin_workers;        /* worker i runs on the i-th allowed CPU */
+	int numa_replicas;      /* copy of models per NUMA node of workers */
+	int pool_size;          /* freed connections kept per worker */
+	int pool_buffer;        /* KB of storage kept per pooled buffer */
+	char * model_file;
+	char * corpus_file;     /* pages of testbed -g, instead of models */
+	char * bench_requests;  /* request heads parsed by testbed -b */
+	int hashing;            /* MARKOV_HASH_* */
+	int loader_threads;     /* threads of init_markov */
+	int cache_size;         /* MB of page cache, 0 disables it */
+	int cache_shards;
+	int stream_words;       /* words of a chunk, 0 sends pages at once */
+	/* [weights]: text name prefix -> weight */
+	int nweights;
+	char ** weight_prefix;
+	int * weight;
+	int order;              /* default order of texts */
+	/* [order]: text name prefix -> order */
+	int norders;
+	char ** order_prefix;
+	int * orders;
 };
 
 void load_config(struct GenConfig * conf, const char * config);
@@ -0,0 +1,82 @@
+#ifndef HTML_H
+#define HTML_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * HTML emitter: pages are written into space reserved in evbuffer,
+ * words and tags are copied with memcpy, numbers with html_uint.
+ */
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTML_MAXUINT 10 /* digits of unsigned int */
+
+/* HTML_LIT: append string literal */
+#define HTML_LIT(p, s) html_str(p, s, sizeof(s) - 1)
+
+static inline char * html_str(char * p, const char * s, size_t len)
+{
+	memcpy(p, s, len);
+	return p + len;
+}
+
+/* html_uint: append decimal v, as %u */
+static inline char * html_uint(char * p, unsigned int v)
+{
+	static const char digits[] = 
+		"00010203040506070809101112131415161718192021222324"
+		"25262728293031323334353637383940414243444546474849"
+		"50515253545556575859606162636465666768697071727374"
+		"75767778798081828384858687888990919293949596979899";
+	char tmp[HTML_MAXUINT];
+	char * t = tmp + sizeof(tmp);
+
+	while (v >= 100) {
+		unsigned int d = (v % 100) * 2;
+		v /= 100;
+		*--t = digits[d + 1];
+		*--t = digits[d];
+	}
+	if (v >= 10) {
+		*--t = digits[v * 2 + 1];
+		*--t = digits[v * 2];
+	} else {
+		*--t = '0' + v;
+	}
+	return html_str(p, t, tmp + sizeof(tmp) - t);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTML_H */
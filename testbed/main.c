@@ -47,6 +47,7 @@
 #include <time.h>
 #include <errno.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <pthread.h>
 
@@ -56,138 +57,393 @@
 #include "markov.h"
 #include "gen_config.h"
 #include "my_signal.h"
+#include "bench.h"
+#include "html.h"
+#include "prng.h"
+#include "cache.h"
+#include "corpus.h"
+#include "affinity.h"
 
 static struct GenConfig config;
-
-static inline int my_rand_r(unsigned * seed)
-{
-	*seed = *seed * 1103515245 + 12345;
-	return (*seed % ((u_int)RAND_MAX + 1));
-}
-
-/* generate: produce html-output */
-void generate(int nwords, 
-#ifdef IDEAL_HASHING		
-		IdealState * state,
-#else
-		TextState * state,
-#endif
-		int intern_links,
-		int extern_links,
+static PageCache * cache;  /* 0 if disabled */
+static Corpus * corpus;    /* pregenerated pages, 0 if none */
+static struct evhttp * http;
+static struct evhttp_header_block * page_headers; /* of every page */
+
+/* state of a page, the text of a page is generated in slices */
+typedef struct PageGen PageGen;
+struct PageGen {
+	const MarkovModel * model;
+	Prng rng;
+	uint32_t prefix[MAXPREF];  /* current prefix */
+	int nwords;                /* words left */
+	int p_open;
+};
+
+/* generate_: produce html-output, up to nslice words */
+/*  order is model->order, it is a constant in every call, 
+    so the loop is specialized for it; returns 1 at the end of text */
+MARKOV_INLINE int generate_(PageGen * g,
+		int nslice,
+		int order,
+		uint32_t intern_links,
+		uint32_t extern_links,
 		int links_total, 
 		char * ext_prefix,
 		char * ext_suffix,
 		int ext_servers,
-		unsigned int * seed,
 		struct evbuffer * buf
 		)
 {
-	State *sp;
-	Suffix *suf;
-	const char *prefix[NPREF], *w = 0;
-	int i, nmatch;
-	int link;
+	const MarkovModel * model = g->model;
+	const MarkovState *sp;
+	uint32_t prefix[MAXPREF], id;
+	uint32_t r[8];  /* random numbers of a word */
+	const char *w;
+	int len;
+	int i;
 	int ext_link, int_link;
-	int p_open = 0;
-
-	for (i = 0; i < NPREF; i++)     /* reset initial prefix */
-		prefix[i] = NONWORD;
-
-	for (i = 0; i < nwords; i++) {
-#ifdef IDEAL_HASHING
-		sp = lookup_ideal(prefix, state->statetab); 
-#else
-		sp = lookup(prefix, state->statetab, 0);
-#endif
-		nmatch = 0;
-		for (suf = sp->suf; suf != NULL; suf = suf->next)
-			if (my_rand_r(seed) % ++nmatch == 0) /* prob = 1/nmatch */
-				w = suf->word;
-
-		if (strcmp(w, NONWORD) == 0)
+	int end = 0;
+	size_t ext_prefix_len = strlen(ext_prefix);
+	size_t ext_suffix_len = strlen(ext_suffix);
+	/* output of a word besides the word itself is at most maxtags */
+	size_t maxtags = sizeof("</p>\n<p>\n<a href=\"http:///.html\"></a> \n")
+		+ ext_prefix_len + ext_suffix_len + 2 * HTML_MAXUINT;
+	char *start, *p;
+
+	memcpy(prefix, g->prefix, order * sizeof(prefix[0]));
+	if (nslice > g->nwords)
+		nslice = g->nwords;
+
+	for (i = 0; i < nslice; i++) {
+		/* random numbers of a word: 0, 1 suffix, 2, 3 link or not, 
+		   4 paragraph, 5 newline; 6, 7 link target, only for links */
+		prng_fill(&g->rng, r, 3);
+
+		sp = markov_lookup_(model, prefix, order);
+		id = markov_sample(model, sp, r[0], r[1]);
+
+		if (id == MARKOV_NONWORD) {
+			end = 1;
 			break;
+		}
+		w   = markov_word(model, id);
+		len = model->words[id].len;
 
-		int_link = (my_rand_r(seed) < (intern_links));
-		ext_link = (my_rand_r(seed) < (extern_links));
+		int_link = r[2] < intern_links;
+		ext_link = r[3] < extern_links;
 
-		if (my_rand_r(seed) < RAND_MAX / 50) {
-			if (p_open) {
-				evbuffer_add_printf(buf, "</p>\n");
+		start = p = (char*)evbuffer_reserve(buf, len + maxtags);
+		if (!p) {
+			end = 1;
+			break;
+		}
+
+		if (r[4] < UINT32_MAX / 50) {
+			if (g->p_open) {
+				p = HTML_LIT(p, "</p>\n");
 			}
-			evbuffer_add_printf(buf, "<p>\n");
-			p_open = 1;
+			p = HTML_LIT(p, "<p>\n");
+			g->p_open = 1;
+		}
+
+		if (int_link || ext_link) {
+			prng_fill(&g->rng, r + 6, 1);
 		}
 
 		if (int_link) {
-			evbuffer_add_printf(buf, "<a href=\"/%d.html\">%s</a> ",
-					(int)(my_rand_r(seed) % links_total), w);
+			p = HTML_LIT(p, "<a href=\"/");
+			p = html_uint(p, prng_range(r[6], links_total));
+			p = HTML_LIT(p, ".html\">");
+			p = html_str(p, w, len);
+			p = HTML_LIT(p, "</a> ");
 		} else if (ext_link) {
-			evbuffer_add_printf(buf, "<a href=\"http://%s%d%s/%d.html\">%s</a> ", 
-					ext_prefix, 
-					my_rand_r(seed) % ext_servers,
-					ext_suffix,
-					(int)(my_rand_r(seed) % links_total), w);
+			p = HTML_LIT(p, "<a href=\"http://");
+			p = html_str(p, ext_prefix, ext_prefix_len);
+			p = html_uint(p, prng_range(r[7], ext_servers));
+			p = html_str(p, ext_suffix, ext_suffix_len);
+			p = HTML_LIT(p, "/");
+			p = html_uint(p, prng_range(r[6], links_total));
+			p = HTML_LIT(p, ".html\">");
+			p = html_str(p, w, len);
+			p = HTML_LIT(p, "</a> ");
 		} else {
-			evbuffer_add_printf(buf, "%s ", w);
+			/* word is stored with trailing space */
+			p = html_str(p, w, len + 1);
 		}
 
-		if (my_rand_r(seed) < RAND_MAX / 3) {
-			evbuffer_add_printf(buf, "\n");
+		if (r[5] < UINT32_MAX / 3) {
+			p = HTML_LIT(p, "\n");
 		}
-		memmove(prefix, prefix + 1, (NPREF - 1) * sizeof(prefix[0]));
-		prefix[NPREF - 1] = w;
+		evbuffer_commit(buf, p - start);
+		memmove(prefix, prefix + 1, (order - 1) * sizeof(prefix[0]));
+		prefix[order - 1] = id;
 	}
 
-	if (p_open) {
-		evbuffer_add_printf(buf, "</p>\n");
+	memcpy(g->prefix, prefix, order * sizeof(prefix[0]));
+	g->nwords = end ? 0 : g->nwords - i;
+	if (g->nwords > 0)
+		return 0;
+
+	if (g->p_open) {
+		evbuffer_add(buf, "</p>\n", sizeof("</p>\n") - 1);
+		g->p_open = 0;
 	}
+	return 1;
 }
 
-void gencb(struct evhttp_request * req, void * data)
+/* generate: produce html-output, up to nslice words */
+int generate(PageGen * g,
+		int nslice,
+		uint32_t intern_links,
+		uint32_t extern_links,
+		int links_total, 
+		char * ext_prefix,
+		char * ext_suffix,
+		int ext_servers,
+		struct evbuffer * buf
+		)
 {
-	struct evbuffer *answer = evbuffer_new();
-	const char * uri = evhttp_request_uri(req);
-	unsigned int seed = 0;
-	int nwords;
-
-	if (sscanf(uri, "/%u.html", &seed) != 1) {
-		seed = time(0);
+#define GENERATE(order) generate_(g, nslice, order, intern_links, \
+		extern_links, links_total, ext_prefix, ext_suffix, ext_servers, \
+		buf)
+
+	switch (g->model->order) {
+	case 1:
+		return GENERATE(1);
+	case 2:
+		return GENERATE(2);
+	case 3:
+		return GENERATE(3);
+	default:
+		return GENERATE(4);
 	}
+#undef GENERATE
+}
 
-	nwords   = my_rand_r(&seed) % config.words_per_page;
+/* page_start: head of html page id of host, 
+   the page is the same for the same host and id */
+static void page_start(PageGen * g, const char * host, unsigned int id, 
+		struct evbuffer * answer)
+{
+	uint32_t r[2];
+	int i;
+	char *start, *p;
+
+	prng_init(&g->rng, prng_key(host, id));
+	prng_fill(&g->rng, r, 1);
+	g->nwords = prng_range(r[0], config.words_per_page);
+	g->model  = markov_pick(r[1]); /* base text */
+	g->p_open = 0;
+	for (i = 0; i < MAXPREF; i++)   /* reset initial prefix */
+		g->prefix[i] = MARKOV_NONWORD;
+
+	start = p = (char*)evbuffer_reserve(answer, 
+			sizeof("<html><head></head><body>\n<title></title>\n")
+			+ HTML_MAXUINT);
+	if (!p) {
+		g->nwords = 0;
+		return;
+	}
+	p = HTML_LIT(p, "<html><head></head><body>\n<title>");
+	p = html_uint(p, id);
+	p = HTML_LIT(p, "</title>\n");
+	evbuffer_commit(answer, p - start);
+}
 
-	evbuffer_expand(answer, nwords * 10);
-	evbuffer_add_printf(answer, "<html><head></head><body>\n"
-			"<title>%u</title>\n", seed);
-	generate(nwords,
-#ifdef IDEAL_HASHING
-			 &ideal_state[my_rand_r(&seed) % num_states] /* base text */,
-#else
-			 &text_state[my_rand_r(&seed) % num_states]  /* base text */,
-#endif
+/* page_next: next nslice words of the page, returns 1 at the end */
+static int page_next(PageGen * g, int nslice, struct evbuffer * answer)
+{
+	if (!generate(g, nslice,
 			config.intern_links, 
 			config.extern_links,
 			config.links_total,
 			config.extern_links_prefix,
 			config.extern_links_suffix,
 			config.extern_links_servers,
-			&seed,
-			answer
-			);
-	evbuffer_add_printf(answer, "</body></html>\n");
+			answer))
+	{
+		return 0;
+	}
+	evbuffer_add(answer, "</body></html>\n", 
+			sizeof("</body></html>\n") - 1);
+	return 1;
+}
 
-	evhttp_add_header(req->output_headers, "Content-Type", 
-			"text/html; charset=windows-1251");
+/* page: html page id of host at once */
+static void page(const char * host, unsigned int id, 
+		struct evbuffer * answer)
+{
+	PageGen g;
+
+	page_start(&g, host, id, answer);
+	evbuffer_expand(answer, g.nwords * 10);
+	page_next(&g, g.nwords, answer);
+}
+
+/* page sent with chunked encoding, a slice at a time */
+typedef struct PageStream PageStream;
+struct PageStream {
+	struct evhttp_request * req;
+	struct evbuffer * buf;
+	PageGen g;
+};
+
+static void stream_free(PageStream * s)
+{
+	evbuffer_free(s->buf);
+	free(s);
+}
+
+/* stream_closed: client is gone before the end of the page */
+static void stream_closed(struct evhttp_connection * evcon, void * arg)
+{
+	stream_free(arg);
+}
+
+/* stream_next: output of the previous slice is written, send next one */
+static void stream_next(struct evhttp_connection * evcon, void * arg)
+{
+	PageStream * s = arg;
+
+	if (!page_next(&s->g, config.stream_words, s->buf)) {
+		evhttp_send_reply_chunk_with_cb(s->req, s->buf, stream_next, s);
+		return;
+	}
+
+	evhttp_connection_set_closecb(s->req->evcon, 0, 0);
+	evhttp_send_reply_chunk(s->req, s->buf);
+	evhttp_send_reply_end(s->req);
+	stream_free(s);
+}
+
+static void stream_start(struct evhttp_request * req, const char * host,
+		unsigned int id)
+{
+	PageStream * s = malloc(sizeof(PageStream));
+
+	s->req = req;
+	s->buf = evbuffer_new();
+	page_start(&s->g, host, id, s->buf);
+
+	evhttp_set_header_block(req, page_headers);
+	evhttp_send_reply_start(req, HTTP_OK, "OK");
+	evhttp_connection_set_closecb(req->evcon, stream_closed, s);
+	stream_next(req->evcon, s);
+}
+
+void gencb(struct evhttp_request * req, void * data)
+{
+	struct evbuffer *answer;
+	const char * uri = evhttp_request_uri(req);
+	const char * host = evhttp_find_header(req->input_headers, "Host");
+	unsigned int id = 0;
+	uint64_t key;
+
+	if (sscanf(uri, "/%u.html", &id) != 1) {
+		id = time(0);
+	}
+	if (!host) {
+		host = "";
+	}
+
+	/* chunked encoding is HTTP/1.1 */
+	if (config.stream_words > 0 && !corpus && !cache
+			&& req->major == 1 && req->minor == 1)
+	{
+		stream_start(req, host, id);
+		return;
+	}
+
+	answer = evbuffer_new();
+	key = prng_key(host, id);
+	if (corpus) {
+		const char * data;
+		size_t len;
+
+		/* pages are the pages of host "", other ids wrap */
+		corpus_page(corpus, id % corpus_pages(corpus), &data, &len);
+		/* sent from the mapping */
+		evbuffer_add_reference(answer, data, len, 0, 0);
+	} else if (!cache || !cache_get(cache, key, answer)) {
+		page(host, id, answer);
+		if (cache) {
+			cache_put(cache, key, answer);
+		}
+	}
+
+	evhttp_set_header_block(req, page_headers);
 	evhttp_send_reply(req, HTTP_OK, "OK", answer);
 	evbuffer_free(answer);
 }
 
+/* statscb: counters of the page cache and connections of workers */
+void statscb(struct evhttp_request * req, void * data)
+{
+	struct evbuffer *answer = evbuffer_new();
+	uint64_t hits = 0, misses = 0, pages = 0, bytes = 0;
+	unsigned long pool_hits, pool_misses;
+	int active[64], queued[64];
+	int i, n;
+
+	if (cache) {
+		cache_stats(cache, &hits, &misses, &pages, &bytes);
+	}
+	evbuffer_add_printf(answer, "cache_hits %llu\ncache_misses %llu\n"
+			"cache_pages %llu\ncache_bytes %llu\n", 
+			(unsigned long long)hits, (unsigned long long)misses,
+			(unsigned long long)pages, (unsigned long long)bytes);
+
+	evhttp_pool_stats(http, &pool_hits, &pool_misses);
+	evbuffer_add_printf(answer, "pool_hits %lu\npool_misses %lu\n",
+			pool_hits, pool_misses);
+
+	n = evhttp_worker_stats(http, active, queued, 64);
+	for (i = 0; i < n && i < 64; ++i) {
+		evbuffer_add_printf(answer, "worker%d_active %d\n"
+				"worker%d_queued %d\n", 
+				i, active[i], i, queued[i]);
+	}
+
+	evhttp_add_header(req->output_headers, "Content-Type", "text/plain");
+	evhttp_send_reply(req, HTTP_OK, "OK", answer);
+	evbuffer_free(answer);
+}
+
+typedef struct Worker Worker;
+
+struct Worker {
+	struct event_base * base;
+	int cpu;               /* -1 if not pinned */
+};
+
+/* model replicas of NUMA nodes, made by their first worker */
+static pthread_mutex_t replica_lock = PTHREAD_MUTEX_INITIALIZER;
+static MarkovModel ** replica;
+
 void * run_thr(void * arg)
 {
-	struct event_base * base = arg;
+	Worker * w = arg;
+	struct event_base * base = w->base;
 	int ret;
 
-	printf("base %p started\n", base);
+	if (w->cpu >= 0 && affinity_pin(w->cpu) != 0) {
+		fprintf(stderr, "cannot pin worker to cpu %d\n", w->cpu);
+		w->cpu = -1;
+	}
+	if (w->cpu >= 0 && replica) {
+		int node = affinity_node(w->cpu);
+
+		pthread_mutex_lock(&replica_lock);
+		if (!replica[node]) {
+			replica[node] = markov_replicate();
+			fprintf(stderr, "models replicated on node %d\n", node);
+		}
+		pthread_mutex_unlock(&replica_lock);
+		markov_use(replica[node]);
+	}
+
+	printf("base %p started, cpu %d\n", base, w->cpu);
 
 	ret = event_base_loop(base, 0);
 
@@ -197,34 +453,170 @@ void * run_thr(void * arg)
 	return 0;
 }
 
+/* load_texts: compile ./texts/ with parameters of gen.ini */
+static void load_texts()
+{
+	MarkovConfig conf;
+
+	conf.hashing      = config.hashing;
+	conf.nthreads     = config.loader_threads;
+	conf.order        = config.order;
+	conf.norders      = config.norders;
+	conf.order_prefix = config.order_prefix;
+	conf.orders       = config.orders;
+	init_markov("./texts/", &conf);
+}
+
+/* load_models: models of model_file or ./texts/, weights of gen.ini */
+static void load_models()
+{
+	if (config.model_file) {
+		load_markov(config.model_file);
+	} else {
+		load_texts();
+	}
+	markov_weights(config.weight_prefix, config.weight, config.nweights);
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "usage: %s [-c model_file] [-b] [-g corpus_file [-n pages]]\n", 
+			name);
+	fprintf(stderr, "  -c model_file  compile ./texts/ into model_file and exit\n");
+	fprintf(stderr, "  -b             run benchmarks and exit\n");
+	fprintf(stderr, "  -g corpus_file generate pages 0..pages-1 into corpus_file "
+			"and exit,\n"
+			"                 pages is links_total by default\n");
+	exit(1);
+}
+
 int main(int argc, char ** argv)
 {
 	int i;
 	int nthreads = 1;
 	pthread_t * threads;
+	Worker * workers;
 	struct event_base *main_base;
-	struct evhttp * http;
+	const char * compile = 0;
+	const char * generate_corpus = 0;
+	long npages = -1;
+	int bench = 0;
+
+	while ((i = getopt(argc, argv, "c:bg:n:h")) != -1) {
+		switch (i) {
+		case 'c':
+			compile = optarg;
+			break;
+		case 'g':
+			generate_corpus = optarg;
+			break;
+		case 'n':
+			npages = atol(optarg);
+			break;
+		case 'b':
+			bench = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
 	load_config(&config, "gen.ini");
+
+	if (compile) {
+		load_texts();
+		save_markov(compile);
+		return 0;
+	}
+
+	if (generate_corpus) {
+		if (npages < 0) npages = config.links_total;
+		if (npages <= 0 || npages > UINT32_MAX) usage(argv[0]);
+		load_models();
+		corpus_write(generate_corpus, npages, config.loader_threads, page);
+		return 0;
+	}
+
+	if (bench) {
+		load_models();
+		bench_lookup();
+		bench_pages(page);
+		bench_numa(page);
+		bench_parse(config.bench_requests);
+		return 0;
+	}
+
 	set_signal(SIGPIPE, SIG_IGN);
 
 	nthreads = config.worker_threads;
 	if (nthreads <= 0) nthreads = 1;
 	threads = malloc(nthreads * sizeof(pthread_t));
+	workers = malloc(nthreads * sizeof(Worker));
 
 	main_base = event_base_new();
 
 	http = evhttp_new(main_base);
+	page_headers = evhttp_header_block_new(
+			"Content-Type: text/html; charset=windows-1251\r\n");
+
+	if (config.corpus_file) {
+		/* text is not generated, models are not needed */
+		corpus = corpus_open(config.corpus_file);
+	} else {
+		load_models();
+	}
+
+	if (config.cache_size > 0 && !corpus) {
+		cache = cache_new((size_t)config.cache_size << 20, 
+				config.cache_shards);
+	}
 
-	init_markov("./texts/");
+	fprintf(stderr, "server started\n");
+
+	/* models are replicated for pinned workers of several nodes */
+	if (config.pin_workers && config.numa_replicas && !corpus) {
+		if (affinity_nodes() > 1) {
+			replica = calloc(affinity_nodes(), sizeof(MarkovModel *));
+		} else {
+			fprintf(stderr, "1 NUMA node, models are not replicated\n");
+		}
+	}
 
 	for (i = 0; i < nthreads; ++i) {
-		pthread_create(&threads[i], 0, run_thr, evhttp_add_worker(http));
+		workers[i].base = evhttp_add_worker(http);
+		workers[i].cpu  = config.pin_workers ? affinity_cpu(i) : -1;
+		if (workers[i].cpu >= 0) {
+			evhttp_worker_set_cpu(http, workers[i].base, workers[i].cpu);
+		}
 	}
 
+	evhttp_set_cb(http, "/stats", statscb, 0);
 	evhttp_set_gencb(http, gencb, 0);
+	evhttp_set_dispatch(http, config.dispatch);
+	evhttp_set_pool(http, config.pool_size, config.pool_buffer * 1024);
+
+	/* workers accept on their own sockets, or the main thread accepts
+	 * and passes connections to them */
+	if (!config.reuseport || evhttp_bind_socket_reuseport(http, 
+			"0.0.0.0", config.daemon_port) != 0) 
+	{
+		if (config.reuseport) {
+			fprintf(stderr, "SO_REUSEPORT failed, "
+					"using one accepting thread\n");
+		}
+		if (evhttp_bind_socket(http, "0.0.0.0", 
+				config.daemon_port) != 0) 
+		{
+			fprintf(stderr, "cannot bind port %d\n", 
+					config.daemon_port);
+			exit(1);
+		}
+	}
 
-	evhttp_bind_socket(http, "0.0.0.0", config.daemon_port);
+	/* bases are not touched by the main thread after this */
+	for (i = 0; i < nthreads; ++i) {
+		pthread_create(&threads[i], 0, run_thr, &workers[i]);
+	}
 
 	event_base_loop(main_base, 0);
 
@@ -233,6 +625,7 @@ int main(int argc, char ** argv)
 	}
 
 	free(threads);
+	free(workers);
 
 	return 0;
 }
@@ -1,312 +1,1377 @@
-/*
- * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
- * All rights reserved.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- * 3. The name of the author may not be used to endorse or promote products
- *    derived from this software without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
- * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
- * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
- * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
- * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
- * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
- * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
- * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
- * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-/*
- * Markov chain random text generator :
- * Copyright (C) 1999 Lucent Technologies
- * Excerpted from 'The Practice of Programming'
- * by Brian W. Kernighan and Rob Pike
- */
-
-/*
- * Ideal hashing algorithm is excerpted from:
- * Introduction to Algorithms, second edition  Introduction to Algorithms, 2/e
- * Thomas H. Cormen, Dartmouth College
- * Charles E. Leiserson, Massachusetts Institute of Technology
- * Ronald L. Rivest, Massachusetts Institute of Technology
- * Clifford Stein, Columbia University
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-
-#include <pthread.h>
-
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <dirent.h>
-#include <unistd.h>
-
-#include <event.h>
-#include <evhttp.h>
-
-#include "markov.h"
-
-const char * NONWORD = "\n";  /* cannot appear as real word */
-int num_states = 0;
-TextState text_state[MARKOV_MAXFILES];
-IdealState ideal_state[MARKOV_MAXFILES];
-
-static const int MULTIPLIER = 31;  /* for hash() */
-
-/* hash: compute hash value for array of NPREF strings */
-static unsigned long hash_(const char *s[NPREF], int nhash, int mult)
-{
-	unsigned long h;
-	unsigned char *p;
-	int i;
-
-	h = 0;
-	for (i = 0; i < NPREF; i++) {
-		for (p = (unsigned char *) s[i]; *p != '\0'; p++) {
-			h = mult * h + *p;
-		}
-		h = mult * h + 1;
-	}
-
-	return h % nhash;
-}
-
-static unsigned long hash(const char *s[NPREF])
-{
-	unsigned long h;
-	unsigned char *p;
-	int i;
-
-	h = 5381;
-	for (i = 0; i < NPREF; i++) {
-		for (p = (unsigned char *) s[i]; *p != '\0'; p++) {
-			h = (h << 5) + h + *p;
-		}
-		h = (h << 5) + h + 1;
-	}
-	return h % NHASH;
-}
-
-/* lookup: search for prefix; create if requested. */
-/*  returns pointer if present or created; NULL if not. */
-/*  creation doesn't strdup so strings mustn't change later. */
-State* lookup(const char *prefix[NPREF], State   **statetab, int create)
-{
-	int i;
-	unsigned long h;
-	State *sp;
-
-	h = hash(prefix);
-	for (sp = statetab[h]; sp != NULL; sp = sp->next) {
-		for (i = 0; i < NPREF; i++)
-			if (strcmp(prefix[i], sp->pref[i]) != 0)
-				break;
-		if (i == NPREF)         /* found it */
-			return sp;
-	}
-	
-	if (create) {
-		sp = (State *) malloc(sizeof(State));
-		for (i = 0; i < NPREF; i++)
-			sp->pref[i] = prefix[i];
-		sp->suf = NULL;
-		sp->next = statetab[h];
-		statetab[h] = sp;
-	}
-	return sp;
-}
-
-State * lookup_ideal(const char * prefix[NPREF], Ideal ** ideal)
-{
-	unsigned long h1;
-	unsigned long h2;
-	Ideal * i;
-
-	h1 = hash(prefix);
-
-	i  = ideal[h1];
-	h2 = hash_(prefix, i->size, i->hash_num);
-
-	if (i->sub[h2] == 0) {
-		fprintf(stderr, "%s %s\n", prefix[0], prefix[1]);
-	}
-	return i->sub[h2];
-}
-
-/* addsuffix: add to state. suffix must not change later */
-void addsuffix(State *sp, const char *suffix)
-{
-	Suffix *suf;
-
-	suf = (Suffix *) malloc(sizeof(Suffix));
-	suf->word = suffix;
-	suf->next = sp->suf;
-	sp->suf = suf;
-}
-
-/* add: add word to suffix list, update prefix */
-static void add(const char *prefix[NPREF], TextState * state, const char *suffix)
-{
-	State *sp;
-
-	sp = lookup(prefix, state->statetab, 1);  /* create if not found */
-	addsuffix(sp, suffix);
-	/* move the words down the prefix */
-	memmove(prefix, prefix+1, (NPREF-1)*sizeof(prefix[0]));
-	prefix[NPREF-1] = suffix;
-}
-
-/* build: read input, build prefix table */
-static void build_markov(const char *prefix[NPREF], TextState * state, FILE *f)
-{
-	char buf[100], fmt[10];
-	/* create a format string; %s could overflow buf */
-	sprintf(fmt, "%%%lds", sizeof(buf)-1);
-	while (fscanf(f, fmt, buf) != EOF)
-		add(prefix, state, strdup(buf));
-}
-
-static Ideal * ideal_hashing_(State * state)
-{
-	State * p;
-	Ideal * r = malloc(sizeof(Ideal));
-	int size1 = 0;
-	int size  = 0;
-	int mult  = 1;
-	int col   = 0;
-
-	for (p = state; p != 0; p = p->next)
-	{
-		size1 += 1;
-	}
-
-	size = size1 * 10;
-	
-	r->sub  = malloc(size * sizeof(State *));
-	r->size = size;
-	
-	memset(r->sub, 0, size * sizeof(State *));
-
-//	fprintf(stderr, " size: %d\n", size);
-	
-	//check 100 hash functions
-	for (; mult < 10000; ++mult) {
-		r->hash_num = mult;
-
-		col = 0;
-		for (p = state; p != 0; p = p->next) {
-			unsigned long h = hash_(p->pref, size, mult);
-			if (r->sub[h]) {
-				//collision
-				memset(r->sub, 0, size * sizeof(State *));
-				col = 1;
-			//	fprintf(stderr, "h = %u\n", h);
-				break;
-			}
-
-			r->sub[h] = p;
-		}
-
-		if (col == 0) {
-			//found !
-			break;
-		}
-	}
-
-	if (col == 1) {
-		fprintf(stderr, "cannot build ideal hashing table!\n");
-		fprintf(stderr, "not found size1, size, hash: %d, %d, %d\n", 
-				size1, size, mult);
-		for (p = state; p != 0; p = p->next) {
-			fprintf(stderr, "'%s %s'\n", p->pref[0], p->pref[1]);
-		}
-		exit(1);
-	}
-	
-	return r;
-}
-
-static void ideal_hashing(State *statetab[NHASH], int num)
-{
-	int i;
-	for (i = 0; i < NHASH; ++i)
-	{
-		if (!statetab[i]) {
-			ideal_state[num].statetab[i] = 0;
-			continue;
-		}
-
-		ideal_state[num].statetab[i] = ideal_hashing_(statetab[i]);
-	}
-}
-
-static void init_file(const char * buf, int num)
-{
-	int i;
-	FILE * f;
-	const char *prefix[NPREF];            /* current input prefix */
-	for (i = 0; i < NPREF; i++)     /* set up initial prefix */
-		prefix[i] = (char*)NONWORD;
-
-	f = fopen(buf, "r");
-	if (!f) {
-		fprintf(stderr, "cannot read %s\n", buf);
-		exit(1);
-	}
-
-	build_markov(prefix, &text_state[num], f);
-	add(prefix, &text_state[num], (char*)NONWORD);
-	fclose(f);
-
-#ifdef IDEAL_HASHING
-	ideal_hashing(text_state[num].statetab, num);
-	fprintf(stderr, "ideal hashing done\n");
-#endif
-}
-
-void init_markov(const char * text_folder)
-{
-	DIR *dp;
-	struct dirent *dir_entry;
-	struct stat stat_info;
-	char buf[MARKOV_MAXPATH];
-	int num = 0;
-
-	if ((dp = opendir(text_folder)) == NULL) {
-		fprintf(stderr, "cannot read folder %s\n", text_folder);
-		exit(-1);
-	}
-
-	while ((dir_entry = readdir(dp)) != NULL) {
-		int err; 
-		strcpy(buf, text_folder);
-		strcat(buf, dir_entry->d_name);
-
-		if ((err = lstat(buf, &stat_info)) != 0) {
-			fprintf(stderr, "cannot stat %s\n", buf);
-			continue;
-		}
-
-		if (S_ISREG(stat_info.st_mode)) {
-			fprintf(stderr, "loading %s\n", buf);
-			init_file(buf, num ++);
-		}
-	}
-
-	num_states = num;
-
-	fprintf(stderr, "server started\n");
-}
-
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Markov chain random text generator :
+ * Copyright (C) 1999 Lucent Technologies
+ * Excerpted from 'The Practice of Programming'
+ * by Brian W. Kernighan and Rob Pike
+ */
+
+/*
+ * Ideal hashing algorithm is excerpted from:
+ * Introduction to Algorithms, second edition  Introduction to Algorithms, 2/e
+ * Thomas H. Cormen, Dartmouth College
+ * Charles E. Leiserson, Massachusetts Institute of Technology
+ * Ronald L. Rivest, Massachusetts Institute of Technology
+ * Clifford Stein, Columbia University
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <event.h>
+#include <evhttp.h>
+
+#include "markov.h"
+
+const char * NONWORD = "\n";  /* cannot appear as real word */
+int num_states = 0;
+MarkovModel * markov_model;
+
+/* grow: double hash table of states */
+static void grow(TextState * state)
+{
+	uint32_t i, h;
+	uint32_t mask = 2 * state->tabsize - 1;
+
+	free(state->statetab);
+	state->tabsize *= 2;
+	state->statetab = calloc(state->tabsize, sizeof(uint32_t));
+	for (i = 0; i < state->nstates; ++i) {
+		h = markov_hash(state->states[i].pref, state->order, 0) & mask;
+		while (state->statetab[h]) {
+			h = (h + 1) & mask;
+		}
+		state->statetab[h] = i + 1;
+	}
+}
+
+/* lookup: search for prefix; create if requested. */
+/*  returns state number if present or created; -1 if not. */
+static uint32_t lookup(const uint32_t * prefix, TextState * state, int create)
+{
+	uint32_t h, n;
+	uint32_t mask = state->tabsize - 1;
+	State *sp;
+
+	h = markov_hash(prefix, state->order, 0) & mask;
+	for (; (n = state->statetab[h]) != 0; h = (h + 1) & mask) {
+		sp = &state->states[n - 1];
+		if (markov_equal(prefix, sp->pref, state->order))  /* found it */
+			return n - 1;
+	}
+	
+	if (!create) {
+		return (uint32_t)-1;
+	}
+
+	if (state->nstates == state->maxstates) {
+		state->maxstates = state->maxstates ? 2 * state->maxstates : 1024;
+		state->states = realloc(state->states, 
+				state->maxstates * sizeof(State));
+	}
+	sp = &state->states[state->nstates];
+	memset(sp->pref, 0, sizeof(sp->pref));
+	memcpy(sp->pref, prefix, state->order * sizeof(prefix[0]));
+	sp->nsuf = 0;
+	state->statetab[h] = ++state->nstates;
+	if (2 * state->nstates > state->tabsize) {
+		grow(state);
+	}
+	return state->nstates - 1;
+}
+
+const MarkovState * markov_lookup(const MarkovModel * m,
+		const uint32_t * prefix)
+{
+	switch (m->order) {
+	case 1:
+		return markov_lookup_(m, prefix, 1);
+	case 2:
+		return markov_lookup_(m, prefix, 2);
+	case 3:
+		return markov_lookup_(m, prefix, 3);
+	default:
+		return markov_lookup_(m, prefix, 4);
+	}
+}
+
+static inline uint32_t hash_suffix(uint32_t sp, uint32_t suffix)
+{
+	uint32_t s[2];
+	s[0] = sp;
+	s[1] = suffix;
+	return markov_hash(s, 2, 0);
+}
+
+/* grow_suffixes: double hash table of suffixes */
+static void grow_suffixes(TextState * state)
+{
+	uint32_t i, h;
+	uint32_t mask = 2 * state->suftabsize - 1;
+
+	free(state->suftab);
+	state->suftabsize *= 2;
+	state->suftab = calloc(state->suftabsize, sizeof(uint32_t));
+	for (i = 0; i < state->nsuf; ++i) {
+		h = hash_suffix(state->suf[i].state, state->suf[i].word) & mask;
+		while (state->suftab[h]) {
+			h = (h + 1) & mask;
+		}
+		state->suftab[h] = i + 1;
+	}
+}
+
+/* addsuffix: add to state, count repeated suffixes */
+static void addsuffix(TextState * state, uint32_t sp, uint32_t suffix)
+{
+	uint32_t h, n;
+	uint32_t mask = state->suftabsize - 1;
+	Suffix *suf;
+
+	state->noccur += 1;
+	h = hash_suffix(sp, suffix) & mask;
+	for (; (n = state->suftab[h]) != 0; h = (h + 1) & mask) {
+		suf = &state->suf[n - 1];
+		if (suf->state == sp && suf->word == suffix) {
+			suf->count += 1;
+			return;
+		}
+	}
+
+	if (state->nsuf == state->maxsuf) {
+		state->maxsuf = state->maxsuf ? 2 * state->maxsuf : 4096;
+		state->suf = realloc(state->suf, state->maxsuf * sizeof(Suffix));
+	}
+	suf = &state->suf[state->nsuf];
+	suf->state = sp;
+	suf->word  = suffix;
+	suf->count = 1;
+	state->states[sp].nsuf += 1;
+	state->suftab[h] = ++state->nsuf;
+	if (2 * state->nsuf > state->suftabsize) {
+		grow_suffixes(state);
+	}
+}
+
+/* add: add word to suffix list, update prefix */
+static void add(uint32_t * prefix, TextState * state, uint32_t suffix)
+{
+	uint32_t sp;
+
+	sp = lookup(prefix, state, 1);  /* create if not found */
+	addsuffix(state, sp, suffix);
+	/* move the words down the prefix */
+	memmove(prefix, prefix+1, (state->order-1)*sizeof(prefix[0]));
+	prefix[state->order-1] = suffix;
+}
+
+/* word table with word -> id index */
+typedef struct Dict Dict;
+struct Dict {
+	uint32_t * id;   /* id + 1, 0 if empty */
+	uint32_t size;   /* power of 2 */
+	MarkovWord * words;
+	uint32_t nwords;
+	uint32_t maxwords;
+	char * text;     /* "word \0" of every word */
+	uint32_t ntext;
+	uint32_t maxtext;
+};
+
+static uint32_t hash_str(const char * s, uint32_t len)
+{
+	uint32_t h = 5381;
+	uint32_t i;
+	for (i = 0; i < len; ++i) {
+		h = (h << 5) + h + (unsigned char)s[i];
+	}
+	return h;
+}
+
+static void dict_init(Dict * d, uint32_t size)
+{
+	memset(d, 0, sizeof(*d));
+	d->size = size;
+	d->id   = calloc(size, sizeof(uint32_t));
+}
+
+/* dict_free: free index, words are kept if they are used */
+static void dict_free(Dict * d)
+{
+	free(d->id);
+	d->id = 0;
+}
+
+static void dict_grow(Dict * d)
+{
+	uint32_t * old = d->id;
+	uint32_t size  = d->size;
+	uint32_t i, h;
+
+	d->size *= 2;
+	d->id    = calloc(d->size, sizeof(uint32_t));
+	for (i = 0; i < size; ++i) {
+		if (old[i]) {
+			const MarkovWord * w = &d->words[old[i] - 1];
+			h = hash_str(d->text + w->off, w->len) & (d->size - 1);
+			while (d->id[h]) {
+				h = (h + 1) & (d->size - 1);
+			}
+			d->id[h] = old[i];
+		}
+	}
+	free(old);
+}
+
+/* intern: return id of the word, add it if it is new */
+static uint32_t intern(Dict * d, const char * s, uint32_t len)
+{
+	uint32_t h = hash_str(s, len) & (d->size - 1);
+	MarkovWord * w;
+
+	while (d->id[h]) {
+		w = &d->words[d->id[h] - 1];
+		if (w->len == len && memcmp(d->text + w->off, s, len) == 0) {
+			return d->id[h] - 1;
+		}
+		h = (h + 1) & (d->size - 1);
+	}
+
+	if (d->nwords == d->maxwords) {
+		d->maxwords = d->maxwords ? 2 * d->maxwords : 1024;
+		d->words = realloc(d->words, d->maxwords * sizeof(MarkovWord));
+	}
+	while (d->ntext + len + 2 > d->maxtext) {
+		d->maxtext = d->maxtext ? 2 * d->maxtext : 16384;
+		d->text = realloc(d->text, d->maxtext);
+	}
+
+	w = &d->words[d->nwords];
+	w->off = d->ntext;
+	w->len = len;
+	memcpy(d->text + d->ntext, s, len);
+	d->text[d->ntext + len]     = ' ';
+	d->text[d->ntext + len + 1] = 0;
+	d->ntext += len + 2;
+
+	d->id[h] = ++d->nwords;
+	if (2 * d->nwords > d->size) {
+		dict_grow(d);
+	}
+	return d->nwords - 1;
+}
+
+/* build: read input, build prefix table */
+static void build_markov(uint32_t * prefix, TextState * state, 
+		Dict * dict, FILE *f)
+{
+	char buf[100], fmt[10];
+	/* create a format string; %s could overflow buf */
+	sprintf(fmt, "%%%lds", sizeof(buf)-1);
+	while (fscanf(f, fmt, buf) != EOF)
+		add(prefix, state, intern(dict, buf, strlen(buf)));
+}
+
+static void ideal_hashing_(MarkovModel * m, uint32_t b)
+{
+	MarkovIdeal * r = &m->ideal[b];
+	uint32_t first = m->bucket[b];
+	uint32_t last  = m->bucket[b + 1];
+	uint32_t * sub;
+	uint32_t i, j;
+	int mult = 1;
+	int col  = 0;
+
+	r->off  = m->nslots;
+	r->size = (last - first) * 10;
+	r->hash_num = 0;
+	m->nslots  += r->size;
+	if (r->size == 0) {
+		return;
+	}
+
+	sub = &m->slots[r->off];
+
+	//check 10000 hash functions
+	for (; mult < 10000; ++mult) {
+		r->hash_num = mult;
+
+		col = 0;
+		memset(sub, 0xff, r->size * sizeof(uint32_t));
+		for (i = first; i < last; ++i) {
+			uint32_t h = markov_hash(&m->pref[i * m->order], m->order, 
+					mult) % r->size;
+			if (sub[h] != (uint32_t)-1) {
+				//collision
+				col = 1;
+				break;
+			}
+
+			sub[h] = i;
+		}
+
+		if (col == 0) {
+			//found !
+			break;
+		}
+	}
+
+	if (col == 1) {
+		fprintf(stderr, "cannot build ideal hashing table!\n");
+		fprintf(stderr, "not found size1, size, hash: %u, %u, %d\n", 
+				last - first, r->size, mult);
+		for (i = first; i < last; ++i) {
+			fprintf(stderr, "'");
+			for (j = 0; j < m->order; ++j) {
+				fprintf(stderr, "%s", 
+						markov_word(m, m->pref[i * m->order + j]));
+			}
+			fprintf(stderr, "'\n");
+		}
+		exit(1);
+	}
+}
+
+static void ideal_hashing(MarkovModel * m)
+{
+	uint32_t i;
+
+	m->ideal  = malloc(m->nbucket * sizeof(MarkovIdeal));
+	m->slots  = malloc(m->nstates * 10 * sizeof(uint32_t));
+	m->nslots = 0;
+	for (i = 0; i < m->nbucket; ++i) {
+		ideal_hashing_(m, i);
+	}
+}
+
+/*
+ * CHD (compress, hash, displace) minimal perfect hashing:
+ * Belazzougui, Botelho, Dietzfelbinger, "Hash, displace, and compress".
+ * Keys are split into nstates / CHD_LAMBDA buckets, buckets are placed
+ * from the largest one, each bucket gets the first displacement that
+ * moves all its keys into free positions. Table has CHD_LOAD percent
+ * load, free positions are left as empty states, so the position of
+ * a key is the number of its state and no rank structure is needed.
+ * The table size is prime, so every displacement step of a key is
+ * coprime with it and all positions are reachable.
+ */
+#define CHD_LAMBDA 5
+#define CHD_LOAD   98
+#define CHD_TRIES  32
+
+/* chd_try: place keys with seed, return 0 if some bucket doesn't fit */
+static int chd_try(const State * keys, uint32_t nkeys, int order, uint32_t n,
+		uint32_t ndisp, uint32_t seed, uint16_t * disp, uint32_t * pos)
+{
+	uint64_t * h     = malloc(nkeys * sizeof(uint64_t));
+	uint32_t * first = calloc(ndisp + 1, sizeof(uint32_t));
+	uint32_t * sorted = malloc(nkeys * sizeof(uint32_t));
+	uint32_t * bysize;
+	uint32_t * cnt;
+	unsigned char * used = calloc(n, 1);
+	uint32_t i, j, b, maxsize = 0;
+	int ok = 1;
+
+	/* keys sorted by bucket */
+	for (i = 0; i < nkeys; ++i) {
+		h[i] = markov_hash64(keys[i].pref, order, seed);
+		first[markov_chd_bucket(h[i], ndisp) + 1] += 1;
+	}
+	for (b = 0; b < ndisp; ++b) {
+		if (first[b + 1] > maxsize) {
+			maxsize = first[b + 1];
+		}
+		first[b + 1] += first[b];
+	}
+	cnt = malloc(((ndisp > maxsize ? ndisp : maxsize) + 1) * sizeof(uint32_t));
+	memcpy(cnt, first, (ndisp + 1) * sizeof(uint32_t));
+	for (i = 0; i < nkeys; ++i) {
+		sorted[cnt[markov_chd_bucket(h[i], ndisp)]++] = i;
+	}
+
+	/* buckets sorted by size, largest first */
+	bysize = malloc(ndisp * sizeof(uint32_t));
+	memset(cnt, 0, (maxsize + 1) * sizeof(uint32_t));
+	for (b = 0; b < ndisp; ++b) {
+		cnt[maxsize - (first[b + 1] - first[b])] += 1;
+	}
+	for (i = 0, j = 0; i <= maxsize; ++i) {
+		uint32_t c = cnt[i];
+		cnt[i] = j;
+		j += c;
+	}
+	for (b = 0; b < ndisp; ++b) {
+		bysize[cnt[maxsize - (first[b + 1] - first[b])]++] = b;
+	}
+
+	memset(disp, 0, ndisp * sizeof(uint16_t));
+	for (i = 0; i < ndisp && ok; ++i) {
+		uint32_t d;
+		b = bysize[i];
+		if (first[b] == first[b + 1]) {
+			break;
+		}
+
+		for (d = 0; d <= 0xffff; ++d) {
+			for (j = first[b]; j < first[b + 1]; ++j) {
+				uint32_t k = sorted[j];
+				pos[k] = markov_chd_pos(h[k], d, n);
+				if (used[pos[k]]) {
+					break;
+				}
+				used[pos[k]] = 1;
+			}
+			if (j == first[b + 1]) {
+				disp[b] = d;
+				break;
+			}
+			/* rollback */
+			while (j-- > first[b]) {
+				used[pos[sorted[j]]] = 0;
+			}
+		}
+		ok = d <= 0xffff;
+	}
+
+	free(used);
+	free(bysize);
+	free(cnt);
+	free(sorted);
+	free(first);
+	free(h);
+	return ok;
+}
+
+/* next_prime: smallest prime >= n */
+static uint32_t next_prime(uint32_t n)
+{
+	uint32_t d;
+
+	for (n = n < 2 ? 2 : n; ; ++n) {
+		for (d = 2; d * d <= n && n % d; ++d)
+			;
+		if (d * d > n) {
+			return n;
+		}
+	}
+}
+
+/* chd_hashing: place states of build table, pos[state] = position */
+static void chd_hashing(MarkovModel * m, const TextState * state, uint32_t * pos)
+{
+	uint32_t nkeys = state->nstates;
+	uint32_t n     = nkeys + nkeys * (100 - CHD_LOAD) / CHD_LOAD + 1;
+	int tries      = 0;
+
+	n = next_prime(n);
+
+	m->ndisp = (nkeys + CHD_LAMBDA - 1) / CHD_LAMBDA;
+	m->disp  = malloc(m->ndisp * sizeof(uint16_t));
+	m->seed  = 0;
+
+	while (!chd_try(state->states, nkeys, state->order, n, m->ndisp, 
+			m->seed, m->disp, pos)) 
+	{
+		/* always succeeds after a few seeds, spare room just in case */
+		m->seed += 1;
+		if (++tries % CHD_TRIES == 0) {
+			n = next_prime(n + n / 100 + 1);
+		}
+	}
+	m->nstates = n;
+}
+
+/* bucket_hashing: sort states of build table by bucket, */
+/*  one bucket per state on average */
+static void bucket_hashing(MarkovModel * m, const TextState * state, uint32_t * pos)
+{
+	uint32_t i, h;
+	uint32_t * cur;
+
+	m->nbucket = state->nstates;
+	m->bucket  = calloc(m->nbucket + 1, sizeof(uint32_t));
+	m->nstates = state->nstates;
+
+	for (i = 0; i < state->nstates; ++i) {
+		pos[i] = markov_hash(state->states[i].pref, state->order, 0) 
+			% m->nbucket;
+		m->bucket[pos[i] + 1] += 1;
+	}
+
+	cur = malloc(m->nbucket * sizeof(uint32_t));
+	for (i = 0; i < m->nbucket; ++i) {
+		m->bucket[i + 1] += m->bucket[i];
+		cur[i] = m->bucket[i];
+	}
+	for (i = 0; i < state->nstates; ++i) {
+		h = pos[i];
+		pos[i] = cur[h]++;
+	}
+	free(cur);
+}
+
+/*
+ * alias_table: Walker alias table of n suffixes with counts, Vose's 
+ * method in integers. An entry with weight count * n is full at total,
+ * small entries are topped up by large ones, which become their alias.
+ */
+static void alias_table(MarkovSuffix * s, const uint32_t * count, uint32_t n,
+		uint64_t * w, uint32_t * small, uint32_t * large)
+{
+	uint64_t total = 0;
+	uint32_t nsmall = 0, nlarge = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; ++i) {
+		total += count[i];
+	}
+	for (i = 0; i < n; ++i) {
+		w[i] = (uint64_t)count[i] * n;
+		if (w[i] < total) {
+			small[nsmall++] = i;
+		} else {
+			large[nlarge++] = i;
+		}
+	}
+
+	while (nsmall > 0 && nlarge > 0) {
+		uint32_t a = small[--nsmall];
+		uint32_t b = large[nlarge - 1];
+
+		s[a].prob  = (uint32_t)(w[a] * MARKOV_PROB_ONE / total);
+		s[a].alias = b;
+		w[b] -= total - w[a];
+		if (w[b] < total) {
+			nlarge -= 1;
+			small[nsmall++] = b;
+		}
+	}
+	/* the rest are full, up to rounding */
+	while (nlarge > 0) {
+		i = large[--nlarge];
+		s[i].prob  = MARKOV_PROB_ONE;
+		s[i].alias = i;
+	}
+	while (nsmall > 0) {
+		i = small[--nsmall];
+		s[i].prob  = MARKOV_PROB_ONE;
+		s[i].alias = i;
+	}
+}
+
+/* compile: flatten prefix table into the model, free prefix table */
+static void compile_markov(TextState * state, MarkovModel * m, int hashing)
+{
+	uint32_t * pos;
+	uint32_t * count;
+	uint64_t * w;
+	uint32_t * small, * large;
+	uint32_t i, n, maxsuf;
+
+	pos = malloc(state->nstates * sizeof(uint32_t));
+	m->hashing = hashing;
+	if (hashing == MARKOV_HASH_CHD) {
+		chd_hashing(m, state, pos);
+	} else {
+		bucket_hashing(m, state, pos);
+	}
+
+	m->order  = state->order;
+	m->states = malloc(m->nstates * sizeof(MarkovState));
+	m->pref   = malloc((uint64_t)m->nstates * m->order * sizeof(uint32_t));
+	m->suf    = malloc(state->nsuf * sizeof(MarkovSuffix));
+	m->nsuf   = state->nsuf;
+
+	/* free places of perfect hashing table are never found */
+	memset(m->states, 0xff, m->nstates * sizeof(MarkovState));
+	memset(m->pref, 0xff, (uint64_t)m->nstates * m->order * sizeof(uint32_t));
+	for (i = 0; i < state->nstates; ++i) {
+		MarkovState * s = &m->states[pos[i]];
+		memcpy(&m->pref[pos[i] * m->order], state->states[i].pref, 
+				m->order * sizeof(uint32_t));
+		s->nsuf = state->states[i].nsuf;
+	}
+
+	/* suffixes of every state get a contiguous range */
+	n = 0;
+	maxsuf = 0;
+	for (i = 0; i < m->nstates; ++i) {
+		MarkovState * s = &m->states[i];
+		if (s->nsuf == (uint32_t)-1) {
+			s->nsuf = 0;
+		}
+		if (s->nsuf > maxsuf) {
+			maxsuf = s->nsuf;
+		}
+		s->suf = n;
+		n += s->nsuf;
+		s->nsuf = 0;
+	}
+	count = malloc(state->nsuf * sizeof(uint32_t));
+	for (i = 0; i < state->nsuf; ++i) {
+		MarkovState * s = &m->states[pos[state->suf[i].state]];
+		count[s->suf + s->nsuf]     = state->suf[i].count;
+		m->suf[s->suf + s->nsuf++].word = state->suf[i].word;
+	}
+
+	w     = malloc(maxsuf * sizeof(uint64_t));
+	small = malloc(maxsuf * sizeof(uint32_t));
+	large = malloc(maxsuf * sizeof(uint32_t));
+	for (i = 0; i < m->nstates; ++i) {
+		MarkovState * s = &m->states[i];
+		alias_table(&m->suf[s->suf], &count[s->suf], s->nsuf, 
+				w, small, large);
+	}
+	free(large);
+	free(small);
+	free(w);
+	free(count);
+
+	free(pos);
+	free(state->statetab);
+	free(state->suftab);
+	free(state->states);
+	free(state->suf);
+	memset(state, 0, sizeof(*state));
+
+	if (hashing == MARKOV_HASH_IDEAL) {
+		ideal_hashing(m);
+	}
+}
+
+/* index_bits: memory of state index, in bits per state */
+static double index_bits(const MarkovModel * m)
+{
+	double size;
+
+	switch (m->hashing) {
+	case MARKOV_HASH_CHD:
+		size = (double)m->ndisp * sizeof(uint16_t);
+		break;
+	case MARKOV_HASH_IDEAL:
+		size = (double)(m->nbucket + 1) * sizeof(uint32_t) 
+			+ (double)m->nbucket * sizeof(MarkovIdeal)
+			+ (double)m->nslots * sizeof(uint32_t);
+		break;
+	default:
+		size = (double)(m->nbucket + 1) * sizeof(uint32_t);
+		break;
+	}
+	return 8.0 * size / (m->nstates ? m->nstates : 1);
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Texts are loaded in three passes:
+ * 1. every text is read with its own word table, in parallel;
+ * 2. word tables are merged into one vocabulary shared by all models;
+ * 3. word ids of every text are renumbered, models are compiled,
+ *    in parallel.
+ */
+typedef struct Text Text;
+struct Text {
+	char * file;
+	int order;        /* number of prefix words */
+	TextState state;
+	Dict dict;        /* words of the text */
+	uint32_t * remap; /* text word id -> vocabulary id */
+	double t;         /* seconds */
+};
+
+/* read_text: pass 1 */
+static void read_text(Text * text)
+{
+	int i;
+	FILE * f;
+	uint32_t prefix[MAXPREF];          /* current input prefix */
+	double t = now();
+
+	memset(&text->state, 0, sizeof(text->state));
+	text->state.order    = text->order;
+	text->state.tabsize  = 1024;
+	text->state.statetab = calloc(text->state.tabsize, sizeof(uint32_t));
+	text->state.suftabsize = 1024;
+	text->state.suftab   = calloc(text->state.suftabsize, sizeof(uint32_t));
+
+	dict_init(&text->dict, 1024);
+	if (intern(&text->dict, NONWORD, strlen(NONWORD)) != MARKOV_NONWORD) {
+		abort();
+	}
+
+	for (i = 0; i < text->order; i++)  /* set up initial prefix */
+		prefix[i] = MARKOV_NONWORD;
+
+	f = fopen(text->file, "r");
+	if (!f) {
+		fprintf(stderr, "cannot read %s\n", text->file);
+		exit(1);
+	}
+
+	build_markov(prefix, &text->state, &text->dict, f);
+	add(prefix, &text->state, MARKOV_NONWORD);
+	fclose(f);
+	dict_free(&text->dict);
+
+	text->t = now() - t;
+}
+
+/* merge_text: pass 2 */
+static void merge_text(Text * text, Dict * vocab)
+{
+	Dict * d = &text->dict;
+	uint32_t i;
+
+	text->remap = malloc(d->nwords * sizeof(uint32_t));
+	for (i = 0; i < d->nwords; ++i) {
+		text->remap[i] = intern(vocab, d->text + d->words[i].off, 
+				d->words[i].len);
+	}
+	free(d->words);
+	free(d->text);
+}
+
+/* compile_text: pass 3 */
+static void compile_text(Text * text, MarkovModel * m, int hashing)
+{
+	TextState * state = &text->state;
+	uint64_t noccur;
+	uint32_t i;
+	int j;
+	double t = now();
+
+	for (i = 0; i < state->nstates; ++i) {
+		for (j = 0; j < text->order; ++j) {
+			state->states[i].pref[j] = text->remap[state->states[i].pref[j]];
+		}
+	}
+	for (i = 0; i < state->nsuf; ++i) {
+		state->suf[i].word = text->remap[state->suf[i].word];
+	}
+	free(text->remap);
+
+	noccur = state->noccur;
+	compile_markov(state, m, hashing);
+	fprintf(stderr, "%s: order %d, %u words, %u states, %llu suffixes, "
+			"%u distinct, index %.2lf bits/state, read %.3lf s, "
+			"compile %.3lf s\n", text->file, text->order, 
+			text->dict.nwords, m->nstates, (unsigned long long)noccur, 
+			m->nsuf, index_bits(m), text->t, now() - t);
+}
+
+/* texts are loaded by a pool of threads, one text by a thread at a time */
+typedef struct Loader Loader;
+struct Loader {
+	pthread_mutex_t lock;
+	Text * texts;
+	int ntexts;
+	int next;
+	int done;
+	int pass;
+	int hashing;
+};
+
+static void * load_thr(void * arg)
+{
+	Loader * l = arg;
+	int num;
+
+	for (;;) {
+		pthread_mutex_lock(&l->lock);
+		num = l->next < l->ntexts ? l->next++ : -1;
+		pthread_mutex_unlock(&l->lock);
+		if (num < 0) {
+			break;
+		}
+
+		if (l->pass == 1) {
+			read_text(&l->texts[num]);
+		} else {
+			compile_text(&l->texts[num], &markov_model[num], l->hashing);
+		}
+
+		pthread_mutex_lock(&l->lock);
+		l->done += 1;
+		fprintf(stderr, "pass %d: %d/%d\n", l->pass, l->done, l->ntexts);
+		pthread_mutex_unlock(&l->lock);
+	}
+	return 0;
+}
+
+static void run_pass(Loader * l, int pass, int nthreads)
+{
+	pthread_t * threads;
+	int i;
+
+	l->pass = pass;
+	l->next = 0;
+	l->done = 0;
+
+	threads = malloc(nthreads * sizeof(pthread_t));
+	for (i = 0; i < nthreads; ++i) {
+		if (pthread_create(&threads[i], 0, load_thr, l) != 0) {
+			fprintf(stderr, "cannot create thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; ++i) {
+		pthread_join(threads[i], 0);
+	}
+	free(threads);
+}
+
+/* basename of text file is the name of the model */
+static char * model_name(const char * file)
+{
+	const char * p = strrchr(file, '/');
+	return strdup(p ? p + 1 : file);
+}
+
+/* text_order: order of the longest prefix of the name, default if none */
+static int text_order(const char * file, const MarkovConfig * conf)
+{
+	const char * p = strrchr(file, '/');
+	const char * name = p ? p + 1 : file;
+	int order = conf->order;
+	int best = -1;
+	int i;
+
+	for (i = 0; i < conf->norders; ++i) {
+		int len = strlen(conf->order_prefix[i]);
+		if (len > best && strncmp(name, conf->order_prefix[i], len) == 0) {
+			best  = len;
+			order = conf->orders[i];
+		}
+	}
+	if (order < 1 || order > MAXPREF) {
+		fprintf(stderr, "%s: order must be from 1 to %d\n", file, MAXPREF);
+		exit(1);
+	}
+	return order;
+}
+
+void init_markov(const char * text_folder, const MarkovConfig * conf)
+{
+	DIR *dp;
+	struct dirent *dir_entry;
+	struct stat stat_info;
+	char buf[MARKOV_MAXPATH];
+	Text * texts = 0;
+	int maxtexts = 0;
+	Dict vocab;
+	Loader l;
+	double t = now();
+	uint64_t nwords = 0;
+	int nthreads = conf->nthreads;
+	int num = 0;
+	int i;
+
+	if ((dp = opendir(text_folder)) == NULL) {
+		fprintf(stderr, "cannot read folder %s\n", text_folder);
+		exit(-1);
+	}
+
+	while ((dir_entry = readdir(dp)) != NULL) {
+		int err; 
+		if (snprintf(buf, sizeof(buf), "%s%s", text_folder, 
+				dir_entry->d_name) >= (int)sizeof(buf)) 
+		{
+			fprintf(stderr, "path is too long: %s%s\n", text_folder,
+					dir_entry->d_name);
+			continue;
+		}
+
+		if ((err = lstat(buf, &stat_info)) != 0) {
+			fprintf(stderr, "cannot stat %s\n", buf);
+			continue;
+		}
+
+		if (S_ISREG(stat_info.st_mode)) {
+			if (num == maxtexts) {
+				maxtexts = maxtexts ? 2 * maxtexts : 64;
+				texts = realloc(texts, maxtexts * sizeof(Text));
+			}
+			memset(&texts[num], 0, sizeof(Text));
+			texts[num].order  = text_order(buf, conf);
+			texts[num ++].file = strdup(buf);
+		}
+	}
+
+	closedir(dp);
+
+	if (nthreads > num) nthreads = num;
+	if (nthreads <= 0) nthreads = 1;
+
+	fprintf(stderr, "loading %d texts with %d threads\n", num, nthreads);
+
+	markov_model = calloc(num ? num : 1, sizeof(MarkovModel));
+
+	pthread_mutex_init(&l.lock, 0);
+	l.texts   = texts;
+	l.ntexts  = num;
+	l.hashing = conf->hashing;
+
+	run_pass(&l, 1, nthreads);
+
+	dict_init(&vocab, 1 << 16);
+	intern(&vocab, NONWORD, strlen(NONWORD));
+	for (i = 0; i < num; ++i) {
+		nwords += texts[i].dict.nwords;
+		merge_text(&texts[i], &vocab);
+	}
+	dict_free(&vocab);
+	vocab.words = realloc(vocab.words, vocab.nwords * sizeof(MarkovWord));
+	vocab.text  = realloc(vocab.text, vocab.ntext);
+	fprintf(stderr, "vocabulary: %u words, %llu words in texts\n",
+			vocab.nwords, (unsigned long long)nwords);
+
+	for (i = 0; i < num; ++i) {
+		MarkovModel * m = &markov_model[i];
+		m->name   = model_name(texts[i].file);
+		m->words  = vocab.words;
+		m->nwords = vocab.nwords;
+		m->text   = vocab.text;
+		m->ntext  = vocab.ntext;
+	}
+
+	run_pass(&l, 3, nthreads);
+	pthread_mutex_destroy(&l.lock);
+
+	for (i = 0; i < num; ++i) {
+		free(texts[i].file);
+	}
+	free(texts);
+	num_states = num;
+	markov_weights(0, 0, 0);
+
+	fprintf(stderr, "%d texts loaded in %.3lf s\n", num, now() - t);
+}
+
+static uint64_t * cum_weight; /* cumulative weights of models */
+static uint64_t total_weight;
+
+void markov_weights(char ** prefix, const int * weight, int n)
+{
+	int i, j;
+
+	free(cum_weight);
+	cum_weight   = malloc((num_states ? num_states : 1) * sizeof(uint64_t));
+	total_weight = 0;
+	for (i = 0; i < num_states; ++i) {
+		const char * name = markov_model[i].name;
+		int best = -1;
+		int w = 1;
+
+		for (j = 0; j < n; ++j) {
+			int len = strlen(prefix[j]);
+			if (len > best && strncmp(name, prefix[j], len) == 0) {
+				best = len;
+				w    = weight[j] > 0 ? weight[j] : 0;
+			}
+		}
+		if (best >= 0) {
+			fprintf(stderr, "model %s: weight %d\n", name, w);
+		}
+
+		total_weight += w;
+		cum_weight[i] = total_weight;
+	}
+
+	if (num_states > 0 && total_weight == 0) {
+		fprintf(stderr, "all models have zero weight\n");
+		exit(1);
+	}
+	if (total_weight > UINT32_MAX) {
+		fprintf(stderr, "total weight of models is too large\n");
+		exit(1);
+	}
+}
+
+/* models of markov_pick in this thread, 0 is markov_model */
+static __thread MarkovModel * local_model;
+
+static void * replicate(const void * src, size_t size)
+{
+	void * p = malloc(size ? size : 1);
+	if (!p) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	/* pages are placed on the node of the first writer */
+	memcpy(p, src, size);
+	return p;
+}
+
+MarkovModel * markov_replicate()
+{
+	MarkovModel * r = replicate(markov_model, 
+			(num_states ? num_states : 1) * sizeof(MarkovModel));
+	MarkovWord * words = 0;
+	char * text = 0;
+	int i;
+
+	if (num_states > 0) {
+		words = replicate(markov_model[0].words, 
+				markov_model[0].nwords * sizeof(MarkovWord));
+		text  = replicate(markov_model[0].text, markov_model[0].ntext);
+	}
+	for (i = 0; i < num_states; ++i) {
+		const MarkovModel * m = &markov_model[i];
+		MarkovModel * c = &r[i];
+
+		c->words  = words;
+		c->text   = text;
+		c->states = replicate(m->states, m->nstates * sizeof(MarkovState));
+		c->pref   = replicate(m->pref, 
+				(size_t)m->nstates * m->order * sizeof(uint32_t));
+		c->suf    = replicate(m->suf, m->nsuf * sizeof(MarkovSuffix));
+		switch (m->hashing) {
+		case MARKOV_HASH_CHD:
+			c->disp   = replicate(m->disp, m->ndisp * sizeof(uint16_t));
+			break;
+		case MARKOV_HASH_IDEAL:
+			c->ideal  = replicate(m->ideal, 
+					m->nbucket * sizeof(MarkovIdeal));
+			c->slots  = replicate(m->slots, m->nslots * sizeof(uint32_t));
+			/* fall through */
+		default:
+			c->bucket = replicate(m->bucket, 
+					(m->nbucket + 1) * sizeof(uint32_t));
+			break;
+		}
+	}
+	return r;
+}
+
+void markov_use(MarkovModel * models)
+{
+	local_model = models;
+}
+
+const MarkovModel * markov_pick(unsigned int r)
+{
+	uint64_t x = ((uint64_t)r * total_weight) >> 32;
+	int lo = 0, hi = num_states - 1;
+
+	/* first model with cum_weight > x */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (cum_weight[mid] > x) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return local_model ? &local_model[lo] : &markov_model[lo];
+}
+
+/*
+ * Model file: header, table of models, vocabulary, 
+ * then arrays of every model.
+ * All references are file offsets, arrays are 8-byte aligned, 
+ * so the file is mapped read-only and used in place.
+ */
+#define MARKOV_MAGIC      "MARKOVM"
+#define MARKOV_VERSION    7
+#define MARKOV_BYTE_ORDER 0x01020304
+
+typedef struct MarkovFileHeader MarkovFileHeader;
+typedef struct MarkovFileModel MarkovFileModel;
+
+struct MarkovFileHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t maxpref;      /* MAXPREF of the compiler */
+	uint32_t nmodels;
+	uint64_t words;        /* vocabulary offsets */
+	uint64_t text;
+	uint32_t nwords;       /* vocabulary sizes */
+	uint32_t ntext;
+};
+
+struct MarkovFileModel {
+	uint64_t name;         /* offsets */
+	uint64_t states;
+	uint64_t pref;
+	uint64_t suf;
+	uint64_t bucket;
+	uint64_t ideal;
+	uint64_t slots;
+	uint64_t disp;
+	uint32_t nname;        /* sizes */
+	uint32_t nstates;
+	uint32_t nsuf;
+	uint32_t nslots;
+	uint32_t ndisp;
+	uint32_t nbucket;
+	uint32_t hashing;
+	uint32_t seed;
+	uint32_t order;
+};
+
+static uint64_t write_section(FILE * f, const void * data, uint64_t size)
+{
+	static const char zero[8];
+	long pos = ftell(f);
+	uint64_t off = (pos + 7) & ~(uint64_t)7;
+
+	if (off != (uint64_t)pos) {
+		fwrite(zero, 1, off - pos, f);
+	}
+	if (size > 0) {
+		fwrite(data, 1, size, f);
+	}
+	return off;
+}
+
+void save_markov(const char * file)
+{
+	MarkovFileHeader h;
+	MarkovFileModel * t;
+	FILE * f;
+	int i;
+
+	f = fopen(file, "wb");
+	if (!f) {
+		fprintf(stderr, "cannot write %s\n", file);
+		exit(1);
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MARKOV_MAGIC, sizeof(h.magic));
+	h.version    = MARKOV_VERSION;
+	h.byte_order = MARKOV_BYTE_ORDER;
+	h.maxpref    = MAXPREF;
+	h.nmodels    = num_states;
+
+	t = calloc(num_states, sizeof(MarkovFileModel));
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(t, sizeof(MarkovFileModel), num_states, f);
+
+	if (num_states > 0) {
+		MarkovModel * m = &markov_model[0];
+		h.nwords = m->nwords;
+		h.ntext  = m->ntext;
+		h.words  = write_section(f, m->words, 
+				(uint64_t)m->nwords * sizeof(MarkovWord));
+		h.text   = write_section(f, m->text, m->ntext);
+	}
+
+	for (i = 0; i < num_states; ++i) {
+		MarkovModel * m = &markov_model[i];
+		t[i].nname   = strlen(m->name) + 1;
+		t[i].nstates = m->nstates;
+		t[i].nsuf    = m->nsuf;
+		t[i].order   = m->order;
+		t[i].name    = write_section(f, m->name, t[i].nname);
+		t[i].states  = write_section(f, m->states, 
+				(uint64_t)m->nstates * sizeof(MarkovState));
+		t[i].pref    = write_section(f, m->pref, 
+				(uint64_t)m->nstates * m->order * sizeof(uint32_t));
+		t[i].suf     = write_section(f, m->suf, 
+				(uint64_t)m->nsuf * sizeof(MarkovSuffix));
+		t[i].hashing = m->hashing;
+		switch (m->hashing) {
+		case MARKOV_HASH_CHD:
+			t[i].ndisp  = m->ndisp;
+			t[i].seed   = m->seed;
+			t[i].disp   = write_section(f, m->disp, 
+					(uint64_t)m->ndisp * sizeof(uint16_t));
+			break;
+		case MARKOV_HASH_IDEAL:
+			t[i].nslots = m->nslots;
+			t[i].ideal  = write_section(f, m->ideal, 
+					(uint64_t)m->nbucket * sizeof(MarkovIdeal));
+			t[i].slots  = write_section(f, m->slots, 
+					(uint64_t)m->nslots * sizeof(uint32_t));
+			/* fall through */
+		default:
+			t[i].nbucket = m->nbucket;
+			t[i].bucket  = write_section(f, m->bucket, 
+					(uint64_t)(m->nbucket + 1) * sizeof(uint32_t));
+			break;
+		}
+	}
+
+	fseek(f, 0, SEEK_SET);
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(t, sizeof(MarkovFileModel), num_states, f);
+	free(t);
+
+	if (ferror(f) | fclose(f)) {
+		fprintf(stderr, "cannot write %s\n", file);
+		exit(1);
+	}
+
+	fprintf(stderr, "%d models saved to %s\n", num_states, file);
+}
+
+static void * map_section(const char * base, uint64_t size, 
+		uint64_t off, uint64_t len, const char * file)
+{
+	if (off > size || len > size - off || (off & 7) != 0) {
+		fprintf(stderr, "%s is corrupted\n", file);
+		exit(1);
+	}
+	return (void*)(base + off);
+}
+
+void load_markov(const char * file)
+{
+	const MarkovFileHeader * h;
+	const MarkovFileModel * t;
+	const MarkovWord * words;
+	const char * text;
+	struct stat st;
+	const char * base;
+	uint64_t size;
+	uint32_t i;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "cannot read %s\n", file);
+		exit(1);
+	}
+
+	size = st.st_size;
+	if (size < sizeof(MarkovFileHeader)) {
+		fprintf(stderr, "%s is corrupted\n", file);
+		exit(1);
+	}
+
+	/* read-only shared mapping: processes share physical pages */
+	base = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "cannot mmap %s\n", file);
+		exit(1);
+	}
+	close(fd);
+
+	h = (const MarkovFileHeader *)base;
+	if (memcmp(h->magic, MARKOV_MAGIC, sizeof(h->magic)) != 0
+			|| h->version != MARKOV_VERSION
+			|| h->byte_order != MARKOV_BYTE_ORDER)
+	{
+		fprintf(stderr, "%s: unsupported model file\n", file);
+		exit(1);
+	}
+	markov_model = calloc(h->nmodels ? h->nmodels : 1, sizeof(MarkovModel));
+	t = map_section(base, size, sizeof(*h), 
+			(uint64_t)h->nmodels * sizeof(MarkovFileModel), file);
+	words = map_section(base, size, h->words, 
+			(uint64_t)h->nwords * sizeof(MarkovWord), file);
+	text  = map_section(base, size, h->text, h->ntext, file);
+	for (i = 0; i < h->nmodels; ++i) {
+		MarkovModel * m = &markov_model[i];
+		m->name    = map_section(base, size, t[i].name, t[i].nname, file);
+		if (t[i].nname == 0 || m->name[t[i].nname - 1] != 0) {
+			fprintf(stderr, "%s is corrupted\n", file);
+			exit(1);
+		}
+		m->words   = (MarkovWord *)words;
+		m->nwords  = h->nwords;
+		m->text    = (char *)text;
+		m->ntext   = h->ntext;
+		m->nstates = t[i].nstates;
+		m->nsuf    = t[i].nsuf;
+		m->order   = t[i].order;
+		if (m->order < 1 || m->order > MAXPREF) {
+			fprintf(stderr, "%s: model %s has order %u, at most %d "
+					"is supported\n", file, m->name, m->order, MAXPREF);
+			exit(1);
+		}
+		m->states  = map_section(base, size, t[i].states, 
+				(uint64_t)m->nstates * sizeof(MarkovState), file);
+		m->pref    = map_section(base, size, t[i].pref, 
+				(uint64_t)m->nstates * m->order * sizeof(uint32_t), file);
+		m->suf     = map_section(base, size, t[i].suf, 
+				(uint64_t)m->nsuf * sizeof(MarkovSuffix), file);
+		m->hashing = t[i].hashing;
+		switch (m->hashing) {
+		case MARKOV_HASH_CHD:
+			m->ndisp  = t[i].ndisp;
+			m->seed   = t[i].seed;
+			m->disp   = map_section(base, size, t[i].disp, 
+					(uint64_t)m->ndisp * sizeof(uint16_t), file);
+			if (m->ndisp == 0 || m->nstates == 0) {
+				fprintf(stderr, "%s is corrupted\n", file);
+				exit(1);
+			}
+			break;
+		case MARKOV_HASH_IDEAL:
+			m->nslots = t[i].nslots;
+			m->nbucket = t[i].nbucket;
+			m->ideal  = map_section(base, size, t[i].ideal, 
+					(uint64_t)m->nbucket * sizeof(MarkovIdeal), file);
+			m->slots  = map_section(base, size, t[i].slots, 
+					(uint64_t)m->nslots * sizeof(uint32_t), file);
+			/* fall through */
+		case MARKOV_HASH_CHAIN:
+			m->nbucket = t[i].nbucket;
+			m->bucket  = map_section(base, size, t[i].bucket, 
+					(uint64_t)(m->nbucket + 1) * sizeof(uint32_t), file);
+			if (m->nbucket == 0) {
+				fprintf(stderr, "%s is corrupted\n", file);
+				exit(1);
+			}
+			break;
+		default:
+			fprintf(stderr, "%s: unknown hashing %u\n", file, m->hashing);
+			exit(1);
+		}
+		fprintf(stderr, "model %u %s: order %u, %u states, %u suffixes, "
+				"index %.2lf bits/state\n", 
+				i, m->name, m->order, m->nstates, m->nsuf, index_bits(m));
+	}
+
+	num_states = h->nmodels;
+	markov_weights(0, 0, 0);
+
+	fprintf(stderr, "vocabulary: %u words\n", h->nwords);
+
+	fprintf(stderr, "%s mapped\n", file);
+}
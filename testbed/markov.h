@@ -1,95 +1,344 @@
-#ifndef MARKOV_H
-#define MARKOV_H
-/*
- * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
- * All rights reserved.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- * 3. The name of the author may not be used to endorse or promote products
- *    derived from this software without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
- * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
- * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
- * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
- * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
- * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
- * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
- * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
- * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-/*
- * Markov chain random text generator :
- * Copyright (C) 1999 Lucent Technologies
- * Excerpted from 'The Practice of Programming'
- * by Brian W. Kernighan and Rob Pike
- */
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#define MARKOV_MAXFILES 100
-#define MARKOV_MAXPATH 3276
-
-	enum {
-		NPREF   = 2,    /* number of prefix words */
-		NHASH   = 40930, /* size of state hash table array */
-		MAXGEN  = 1000  /* maximum words generated */
-	};
-
-	typedef struct State State;
-	typedef struct Suffix Suffix;
-	typedef struct TextState TextState;
-	typedef struct IdealState IdealState;
-
-	struct Suffix { /* list of suffixes */
-		const char    *word;                  /* suffix */
-		Suffix  *next;                  /* next in list of suffixes */
-	};
-
-	struct State {  /* prefix + suffix list */
-		const char    *pref[NPREF];   /* prefix words */
-		Suffix  *suf;                   /* list of suffixes */
-		State   *next;                  /* next in hash table */
-	};
-
-	struct TextState {
-		State   *statetab[NHASH];       /* hash table of states */
-	};
-
-	typedef struct Ideal Ideal;
-	
-	struct Ideal {
-		State ** sub;
-		int size;
-		int hash_num;
-	};
-
-	struct IdealState {
-		Ideal * statetab[NHASH];
-	};
-
-	extern const char * NONWORD;
-	extern TextState  text_state[MARKOV_MAXFILES];
-	extern IdealState ideal_state[MARKOV_MAXFILES];
-	extern int num_states;
-
-	State* lookup(const char *prefix[NPREF], State   **statetab, int create);
-	State * lookup_ideal(const char * prefix[NPREF], Ideal ** ideal);
-	void init_markov(const char * text_folder);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif /* MARKOV_H */
+#ifndef MARKOV_H
+#define MARKOV_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Markov chain random text generator :
+ * Copyright (C) 1999 Lucent Technologies
+ * Excerpted from 'The Practice of Programming'
+ * by Brian W. Kernighan and Rob Pike
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MARKOV_MAXPATH 3276
+#define MARKOV_NONWORD 0 /* id of NONWORD in every compiled model */
+
+#ifdef __GNUC__
+#define MARKOV_INLINE static inline __attribute__((always_inline))
+#else
+#define MARKOV_INLINE static inline
+#endif
+
+	enum {          /* state index of compiled model */
+		MARKOV_HASH_CHAIN = 0, /* hash buckets, linear search */
+		MARKOV_HASH_IDEAL = 1, /* hash buckets, ideal hashing of buckets */
+		MARKOV_HASH_CHD   = 2  /* minimal perfect hashing */
+	};
+
+	enum {
+		MAXPREF = 4,    /* maximum number of prefix words (order) */
+		NPREF   = 2,    /* default number of prefix words */
+		MAXGEN  = 1000  /* maximum words generated */
+	};
+
+	typedef struct State State;
+	typedef struct Suffix Suffix;
+	typedef struct TextState TextState;
+	typedef struct MarkovWord MarkovWord;
+	typedef struct MarkovSuffix MarkovSuffix;
+	typedef struct MarkovState MarkovState;
+	typedef struct MarkovIdeal MarkovIdeal;
+	typedef struct MarkovModel MarkovModel;
+	typedef struct MarkovConfig MarkovConfig;
+
+	struct MarkovWord {
+		uint32_t off;          /* "word \0" in MarkovModel::text */
+		uint32_t len;          /* length of word without space */
+	};
+
+	struct Suffix { /* distinct suffix of a state */
+		uint32_t state;        /* prefix state */
+		uint32_t word;         /* suffix */
+		uint32_t count;        /* number of occurrences */
+	};
+
+	struct State {  /* prefix */
+		uint32_t pref[MAXPREF];  /* prefix words, order are used */
+		uint32_t nsuf;           /* number of distinct suffixes */
+	};
+
+	struct TextState { /* used while reading a text */
+		int      order;            /* number of prefix words */
+		uint32_t *statetab;        /* hash table of states, state + 1 */
+		uint32_t tabsize;          /* power of 2 */
+		State   *states;
+		uint32_t nstates;
+		uint32_t maxstates;
+		uint32_t *suftab;          /* hash table of suffixes, suffix + 1 */
+		uint32_t suftabsize;       /* power of 2 */
+		Suffix  *suf;              /* distinct suffixes in text order */
+		uint32_t nsuf;
+		uint32_t maxsuf;
+		uint64_t noccur;           /* number of suffix occurrences */
+	};
+
+	/*
+	 * Compiled model. TextState is flattened into contiguous arrays
+	 * indexed by word id: suffixes of every state occupy a contiguous
+	 * range of suf, prefix of state i is pref[i * order .. + order).
+	 * States are sorted by hash bucket (chain, ideal) or placed at 
+	 * their perfect hash value (chd).
+	 */
+	struct MarkovState {
+		uint32_t suf;          /* first suffix in MarkovModel::suf */
+		uint32_t nsuf;         /* number of distinct suffixes */
+	};
+
+	/*
+	 * Suffixes of a state are a Walker alias table: suffix i of the 
+	 * range is chosen with a uniform i, then it is kept if a uniform 
+	 * 31-bit number is below prob, else it is replaced by its alias.
+	 */
+#define MARKOV_PROB_ONE 0x80000000u
+	struct MarkovSuffix {
+		uint32_t word;         /* suffix id */
+		uint32_t alias;        /* other suffix of the range */
+		uint32_t prob;         /* MARKOV_PROB_ONE keeps the word always */
+	};
+
+	struct MarkovIdeal {   /* second level of ideal hashing */
+		uint32_t off;          /* first slot in MarkovModel::slots */
+		uint32_t size;         /* number of slots */
+		uint32_t hash_num;     /* multiplier */
+	};
+
+	struct MarkovModel {
+		const char * name;     /* text file name */
+		/* vocabulary is shared by all models */
+		MarkovWord * words;    /* id -> word */
+		uint32_t nwords;
+		char * text;           /* words, each followed by " \0" */
+		uint32_t ntext;
+
+		uint32_t order;        /* number of prefix words */
+		MarkovState * states;
+		uint32_t nstates;
+		uint32_t * pref;       /* prefix ids, order per state */
+		MarkovSuffix * suf;    /* alias tables of states */
+		uint32_t nsuf;
+
+		uint32_t hashing;      /* MARKOV_HASH_* */
+		/* chain, ideal */
+		uint32_t * bucket;     /* nbucket + 1 offsets into states */
+		uint32_t nbucket;
+		/* ideal */
+		MarkovIdeal * ideal;   /* nbucket entries */
+		uint32_t * slots;      /* state numbers */
+		uint32_t nslots;
+		/* chd: state = (f1 + d0 * f2 + d1) % nstates, 
+		        d0, d1 = disp[bucket] >> 8, disp[bucket] & 0xff */
+		uint16_t * disp;
+		uint32_t ndisp;
+		uint32_t seed;
+	};
+
+	struct MarkovConfig {
+		int hashing;           /* MARKOV_HASH_* */
+		int nthreads;          /* threads reading texts */
+		int order;             /* default number of prefix words */
+		/* order of texts by the longest prefix of the file name */
+		int norders;
+		char ** order_prefix;
+		int * orders;
+	};
+
+	/* word text, followed by a space */
+	static inline const char * markov_word(const MarkovModel * m, 
+			uint32_t id)
+	{
+		return m->text + m->words[id].off;
+	}
+
+	/*
+	 * Hashing and lookup of prefixes. They are inline: callers with
+	 * constant order get code specialized for that order.
+	 */
+
+	/* markov_hash: hash value for array of order word ids */
+	MARKOV_INLINE uint32_t markov_hash(const uint32_t * s, int order,
+			uint32_t mult)
+	{
+		uint32_t h = 2166136261u ^ (mult * 0x9e3779b9u);
+		int i;
+
+		for (i = 0; i < order; i++) {
+			h ^= s[i];
+			h *= 0x85ebca6bu;
+			h ^= h >> 13;
+		}
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	/* markov_hash64: 64-bit hash value for array of order word ids */
+	MARKOV_INLINE uint64_t markov_hash64(const uint32_t * s, int order,
+			uint64_t seed)
+	{
+		uint64_t h = seed * 0x9e3779b97f4a7c15ull;
+		int i;
+
+		for (i = 0; i < order; i++) {
+			h ^= s[i];
+			h *= 0xbf58476d1ce4e5b9ull;
+			h ^= h >> 31;
+		}
+		h *= 0x94d049bb133111ebull;
+		h ^= h >> 29;
+		return h;
+	}
+
+	MARKOV_INLINE int markov_equal(const uint32_t * a, const uint32_t * b,
+			int order)
+	{
+		int i;
+		for (i = 0; i < order; i++)
+			if (a[i] != b[i])
+				return 0;
+		return 1;
+	}
+
+	/* markov_fastrange: map 32-bit x into [0, n) */
+	MARKOV_INLINE uint32_t markov_fastrange(uint32_t x, uint32_t n)
+	{
+		return (uint32_t)(((uint64_t)x * n) >> 32);
+	}
+
+	/* markov_chd_bucket: displacement bucket of the key with hash h */
+	MARKOV_INLINE uint32_t markov_chd_bucket(uint64_t h, uint32_t ndisp)
+	{
+		return markov_fastrange((uint32_t)(h >> 32), ndisp);
+	}
+
+	/* markov_chd_pos: position of the key with hash h, displacement d */
+	MARKOV_INLINE uint32_t markov_chd_pos(uint64_t h, uint32_t d, uint32_t n)
+	{
+		uint64_t g = (h ^ (h >> 32)) * 0xd6e8feb86659fd93ull;
+		uint32_t f1, f2;
+
+		g ^= g >> 32;
+		f1 = markov_fastrange((uint32_t)g, n);
+		/* f2 in [1, n), coprime with n as n is prime */
+		f2 = 1 + markov_fastrange((uint32_t)(g >> 32), n - 1);
+		return (uint32_t)((f1 + (uint64_t)(d >> 8) * f2 + (d & 0xff)) % n);
+	}
+
+	MARKOV_INLINE const MarkovState * markov_lookup_chain(
+			const MarkovModel * m, const uint32_t * prefix, int order)
+	{
+		uint32_t h = markov_hash(prefix, order, 0) % m->nbucket;
+		uint32_t i = m->bucket[h];
+		uint32_t end = m->bucket[h + 1];
+
+		for (; i != end; ++i) {
+			if (markov_equal(prefix, &m->pref[i * order], order))
+				return &m->states[i];
+		}
+		return 0;
+	}
+
+	MARKOV_INLINE const MarkovState * markov_lookup_ideal(
+			const MarkovModel * m, const uint32_t * prefix, int order)
+	{
+		uint32_t h = markov_hash(prefix, order, 0) % m->nbucket;
+		const MarkovIdeal * i = &m->ideal[h];
+
+		return &m->states[m->slots[i->off + 
+				markov_hash(prefix, order, i->hash_num) % i->size]];
+	}
+
+	MARKOV_INLINE const MarkovState * markov_lookup_chd(
+			const MarkovModel * m, const uint32_t * prefix, int order)
+	{
+		uint64_t h = markov_hash64(prefix, order, m->seed);
+
+		return &m->states[markov_chd_pos(h, 
+				m->disp[markov_chd_bucket(h, m->ndisp)], m->nstates)];
+	}
+
+	/* markov_sample: suffix of state, r1 and r2 are 32-bit random */
+	MARKOV_INLINE uint32_t markov_sample(const MarkovModel * m,
+			const MarkovState * sp, uint32_t r1, uint32_t r2)
+	{
+		const MarkovSuffix * s = &m->suf[sp->suf];
+		const MarkovSuffix * x = &s[markov_fastrange(r1, sp->nsuf)];
+
+		return (r2 >> 1) < x->prob ? x->word : s[x->alias].word;
+	}
+
+	/* markov_lookup_: find state, order is m->order */
+	/*  prefix must be present in the model unless hashing is chain */
+	MARKOV_INLINE const MarkovState * markov_lookup_(const MarkovModel * m,
+			const uint32_t * prefix, int order)
+	{
+		switch (m->hashing) {
+		case MARKOV_HASH_CHD:
+			return markov_lookup_chd(m, prefix, order);
+		case MARKOV_HASH_IDEAL:
+			return markov_lookup_ideal(m, prefix, order);
+		default:
+			return markov_lookup_chain(m, prefix, order);
+		}
+	}
+
+	extern const char * NONWORD;
+	extern MarkovModel * markov_model; /* num_states models */
+
+	/* markov_pick: choose model with probability proportional to 
+	   its weight, r is 32-bit random */
+	const MarkovModel * markov_pick(unsigned int r);
+	/* markov_weights: weight of a model is the weight of the longest 
+	   prefix of its name, 1 if nothing matches, 0 disables the model */
+	void markov_weights(char ** prefix, const int * weight, int n);
+	/* markov_replicate: copy of markov_model and its tables, placed on
+	   the NUMA node of the calling thread */
+	MarkovModel * markov_replicate();
+	/* markov_use: markov_pick of the calling thread returns models of
+	   a replica, 0 returns markov_model */
+	void markov_use(MarkovModel * models);
+	extern int num_states;
+
+	/* markov_lookup: markov_lookup_ for any order */
+	const MarkovState * markov_lookup(const MarkovModel * m,
+			const uint32_t * prefix);
+	void init_markov(const char * text_folder, const MarkovConfig * conf);
+	/* compiled models of init_markov -> file */
+	void save_markov(const char * file);
+	/* map compiled models from file, instead of init_markov */
+	void load_markov(const char * file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MARKOV_H */
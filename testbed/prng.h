@@ -0,0 +1,111 @@
+#ifndef PRNG_H
+#define PRNG_H
+/*
+ * Copyright 2008 Alexey Ozeritsky <aozeritsky@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Counter-based random numbers: number n of the stream with key k is
+ * the SplitMix64 finalizer of k + (n + 1) * gamma. Any number of the
+ * stream is computed without the previous ones, so a batch is a loop
+ * without dependencies between iterations, and a page is reproduced
+ * from its key alone.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PRNG_GAMMA 0x9e3779b97f4a7c15ull
+
+typedef struct Prng Prng;
+struct Prng {
+	uint64_t key;
+	uint64_t ctr;   /* 64-bit numbers used */
+};
+
+static inline uint64_t prng_mix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* prng_key: key of page id of host */
+static inline uint64_t prng_key(const char * host, uint64_t id)
+{
+	uint64_t h = 14695981039346656037ull;   /* FNV-1a */
+
+	for (; *host; ++host) {
+		h ^= (unsigned char)*host;
+		h *= 1099511628211ull;
+	}
+	return prng_mix(h) ^ prng_mix(id * PRNG_GAMMA);
+}
+
+static inline void prng_init(Prng * r, uint64_t key)
+{
+	r->key = key;
+	r->ctr = 0;
+}
+
+/* prng_fill: next 2 * n 32-bit numbers */
+static inline void prng_fill(Prng * r, uint32_t * out, int n)
+{
+	uint64_t x = r->key + r->ctr * PRNG_GAMMA;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		uint64_t z = prng_mix(x + (uint64_t)(i + 1) * PRNG_GAMMA);
+		out[2 * i]     = (uint32_t)z;
+		out[2 * i + 1] = (uint32_t)(z >> 32);
+	}
+	r->ctr += n;
+}
+
+/* prng_range: map 32-bit x into [0, n) with multiply-shift */
+static inline uint32_t prng_range(uint32_t x, uint32_t n)
+{
+	return (uint32_t)(((uint64_t)x * n) >> 32);
+}
+
+/* prng_prob: 32-bit threshold of probability p, x < threshold has p */
+static inline uint32_t prng_prob(double p)
+{
+	if (p <= 0)
+		return 0;
+	if (p >= 1)
+		return UINT32_MAX;
+	return (uint32_t)(p * 4294967296.0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRNG_H */